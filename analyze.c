@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "emulator.h"
+#include "opcodes.h"
+#include "rom.h"
+#include "machine.h"
+#include "romindex.h"
+
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-r rom_folder] [-o index] [-l listing] [-n top]\n", name);
+  exit(1);
+}
+
+/*
+ * mnemonic with its d8/d16/adr operand replaced by the value at adr
+ */
+void format_instruction(char *out, size_t size, const uint8_t *memory, uint16_t adr){
+  const char *name = opcode_names[memory[adr]];
+  const char *field = NULL;
+  const char *fields[] = {"d16", "d8", "adr"};
+  for(int i = 0; i < 3 && field == NULL; i++){
+    field = strstr(name, fields[i]);
+  }
+  if(field == NULL){
+    snprintf(out, size, "%s", name);
+    return;
+  }
+  char value[8];
+  if(opcode_lengths[memory[adr]] == 3){
+    snprintf(value, sizeof(value), "%04x", make_word(memory[adr + 2], memory[adr + 1]));
+  }
+  else {
+    snprintf(value, sizeof(value), "%02x", memory[adr + 1]);
+  }
+  int skip = field[0] == 'd' ? (field[1] == '8' ? 2 : 3) : 3;
+  snprintf(out, size, "%.*s%s%s", (int) (field - name), name, value, field + skip);
+}
+
+/*
+ * disassembly with block labels and routine headers, unreached bytes as db
+ */
+int write_listing(RomIndex *index, const uint8_t *memory, const char *path){
+  FILE *f = fopen(path, "w");
+  if(f == NULL){
+    return -1;
+  }
+  uint32_t *callers = (uint32_t *) calloc(index->size, sizeof(uint32_t));
+  for(int i = 0; i < index->call_count; i++){
+    callers[index->calls[i].callee] += index->calls[i].sites;
+  }
+
+  uint32_t adr = 0;
+  while(adr < index->size){
+    uint8_t flags = index->flags[adr];
+    if(flags & ROMINDEX_ROUTINE){
+      if(adr % 8 == 0 && adr <= 0x38 && callers[adr] == 0){
+        fprintf(f, "\n; vector %04x\n", adr);
+      }
+      else {
+        fprintf(f, "\n; routine %04x, %u call sites\n", adr, callers[adr]);
+      }
+    }
+    if(flags & ROMINDEX_LEADER){
+      fprintf(f, "L%04x:\n", adr);
+    }
+    if(flags & ROMINDEX_CODE){
+      char text[32];
+      int len = opcode_lengths[memory[adr]];
+      format_instruction(text, sizeof(text), memory, adr);
+      fprintf(f, "  %04x  ", adr);
+      for(int i = 0; i < 3; i++){
+        if(i < len){
+          fprintf(f, "%02x ", memory[adr + i]);
+        }
+        else {
+          fprintf(f, "   ");
+        }
+      }
+      fprintf(f, " %s%s\n", text, (flags & ROMINDEX_INDIRECT) ? "  ; indirect" : "");
+      adr += len;
+      continue;
+    }
+    fprintf(f, "  %04x  db", adr);
+    int n = 0;
+    do {
+      fprintf(f, "%s%02x", n ? "," : " ", memory[adr]);
+      adr++;
+      n++;
+    } while(n < 8 && adr < index->size && !(index->flags[adr] & (ROMINDEX_CODE | ROMINDEX_OPERAND)));
+    fprintf(f, "\n");
+  }
+  free(callers);
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+int compare_callees(const void *a, const void *b){
+  const CallEdge *x = (const CallEdge *) a;
+  const CallEdge *y = (const CallEdge *) b;
+  return (int) y->sites - (int) x->sites;
+}
+
+void print_summary(RomIndex *index, int top){
+  long instructions = 0;
+  long code = 0;
+  long routines = 0;
+  long indirect = 0;
+  for(uint32_t adr = 0; adr < index->size; adr++){
+    instructions += (index->flags[adr] & ROMINDEX_CODE) != 0;
+    code += (index->flags[adr] & (ROMINDEX_CODE | ROMINDEX_OPERAND)) != 0;
+    routines += (index->flags[adr] & ROMINDEX_ROUTINE) != 0;
+    indirect += (index->flags[adr] & ROMINDEX_INDIRECT) != 0;
+  }
+  printf("rom:          %u bytes, checksum %08x\n", index->size, index->checksum);
+  printf("entries:     ");
+  for(int i = 0; i < index->entry_count; i++){
+    printf(" %04x", index->entries[i]);
+  }
+  printf("\n");
+  printf("code:         %ld bytes, %ld instructions\n", code, instructions);
+  printf("data:         %ld bytes\n", (long) index->size - code);
+  printf("blocks:       %d\n", index->block_count);
+  printf("routines:     %ld\n", routines);
+  printf("call edges:   %d\n", index->call_count);
+  printf("indirect:     %ld\n", indirect);
+  printf("conflicts:    %d\n", index->conflicts);
+  printf("external:     %d\n", index->externals);
+
+  // fold the edges into call sites per callee
+  CallEdge *callees = (CallEdge *) calloc(index->call_count + 1, sizeof(CallEdge));
+  int count = 0;
+  for(int i = 0; i < index->call_count; i++){
+    int j = 0;
+    while(j < count && callees[j].callee != index->calls[i].callee){
+      j++;
+    }
+    if(j == count){
+      callees[count].callee = index->calls[i].callee;
+      count++;
+    }
+    callees[j].caller++;
+    callees[j].sites += index->calls[i].sites;
+  }
+  qsort(callees, count, sizeof(CallEdge), compare_callees);
+  if(count > 0 && top > 0){
+    printf("\n%-8s %8s %8s\n", "routine", "sites", "callers");
+  }
+  for(int i = 0; i < count && i < top; i++){
+    printf("%04x     %8u %8u\n", callees[i].callee, callees[i].sites, callees[i].caller);
+  }
+  free(callees);
+}
+
+int main(int argc, char **argv){
+  char *folder = "rom";
+  char *index_path = "invaders.idx";
+  char *listing_path = NULL;
+  int top = 10;
+  int opt;
+  while((opt = getopt(argc, argv, "r:o:l:n:")) != -1){
+    switch(opt){
+      case 'r':
+        folder = optarg;
+        break;
+      case 'o':
+        index_path = optarg;
+        break;
+      case 'l':
+        listing_path = optarg;
+        break;
+      case 'n':
+        top = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  uint8_t *memory = (uint8_t *) calloc(MEMORY_ALLOC, 1);
+  load_invaders(memory, folder);
+  RomIndex *index = romindex_analyze(memory, INVADERS_ROM_SIZE);
+  print_summary(index, top);
+
+  int status = 0;
+  if(romindex_write(index, index_path) != 0){
+    fprintf(stderr, "could not write %s\n", index_path);
+    status = 1;
+  }
+  else {
+    // what consumers will see has to match what was found
+    RomIndex *loaded = romindex_load(index_path, memory);
+    if(loaded == NULL || loaded->block_count != index->block_count ||
+       memcmp(loaded->flags, index->flags, sizeof(index->flags)) != 0){
+      fprintf(stderr, "%s does not read back as written\n", index_path);
+      status = 1;
+    }
+    romindex_free(loaded);
+  }
+  if(listing_path && write_listing(index, memory, listing_path) != 0){
+    fprintf(stderr, "could not write %s\n", listing_path);
+    status = 1;
+  }
+
+  romindex_free(index);
+  free(memory);
+  return status;
+}
@@ -0,0 +1,167 @@
+#ifndef __AOT__
+#define __AOT__
+
+#include "batch.h"
+#include "idiom.h"
+
+/*
+ * registers of a translated run, kept in one local struct the compiler
+ * can break up into host registers
+ */
+typedef struct AotRegs {
+  uint8_t *memory;
+  State8080 *state;
+  uint16_t pc;
+  uint16_t sp;
+  uint16_t bc;
+  uint16_t de;
+  uint16_t hl;
+  uint8_t a;
+  uint8_t z;
+  uint8_t s;
+  uint8_t p;
+  uint8_t cy;
+  uint8_t ac;
+  // blocks the run may enter, one byte per address
+  const uint8_t *gate;
+  // pages (256 bytes) holding code a write must be reported for, set to
+  // AOT_WRITTEN when that happens
+  uint8_t *watch;
+  // the run has to end after this instruction: it stored into a watched
+  // page or it was EI or OUT
+  uint8_t touched;
+} AotRegs;
+
+#define AOT_WATCHED 1
+#define AOT_WRITTEN 2
+
+#define AOT_LOAD(r, st) do { (r).memory = (st)->memory; (r).state = (st); (r).pc = (st)->pc; \
+    (r).sp = (st)->sp; (r).bc = (st)->bc; (r).de = (st)->de; (r).hl = (st)->hl; (r).a = (st)->a; \
+    (r).z = (st)->cc.z; (r).s = (st)->cc.s; (r).p = (st)->cc.p; (r).cy = (st)->cc.cy; \
+    (r).ac = (st)->cc.ac; } while(0)
+#define AOT_STORE(r, st) do { (st)->pc = (r).pc; (st)->sp = (r).sp; (st)->bc = (r).bc; \
+    (st)->de = (r).de; (st)->hl = (r).hl; (st)->a = (r).a; (st)->cc.z = (r).z; (st)->cc.s = (r).s; \
+    (st)->cc.p = (r).p; (st)->cc.cy = (r).cy; (st)->cc.ac = (r).ac; } while(0)
+
+// every store of a translated or predecoded block checks the watched pages
+#undef WRITE
+#define WRITE(adr, val) do { uint16_t wa_ = (adr); uint8_t wv_ = (val); if(memory_writable(state, wa_)){ \
+    if(r->watch[wa_ >> 8]){ r->watch[wa_ >> 8] = AOT_WRITTEN; r->touched = 1; } \
+    MEMORY_WRITE(memory, wa_, wv_); } } while(0)
+#undef EI
+#define EI() do { state->int_enable = 1; state->int_delay = 1; r->touched = 1; } while(0)
+// and ends at an OUT the same way, so every write reaches a device
+#undef OUT
+#define OUT(port) do { state->out_port = (port); state->out_value = a; state->out_written = 1; r->touched = 1; } while(0)
+
+/*
+ * execute one instruction whose opcode byte r->pc has already moved past,
+ * returns the cycles it took beyond opcode_cycles[]. Translated code calls
+ * it with a constant opcode, so the switch folds down to that one case
+ */
+static inline __attribute__((always_inline)) int aot_step(AotRegs *r, uint8_t opcode){
+  uint8_t *memory = r->memory;
+  State8080 *state = r->state;
+  uint16_t pc = r->pc;
+  uint16_t sp = r->sp;
+  uint16_t bc = r->bc;
+  uint16_t de = r->de;
+  uint16_t hl = r->hl;
+  uint8_t a = r->a;
+  uint8_t z = r->z;
+  uint8_t s = r->s;
+  uint8_t p = r->p;
+  uint8_t cy = r->cy;
+  uint8_t ac = r->ac;
+  int cycles = 0;
+
+  switch(opcode){
+#include "batch_cases.h"
+  }
+
+  r->pc = pc;
+  r->sp = sp;
+  r->bc = bc;
+  r->de = de;
+  r->hl = hl;
+  r->a = a;
+  r->z = z;
+  r->s = s;
+  r->p = p;
+  r->cy = cy;
+  r->ac = ac;
+  return cycles;
+}
+
+/*
+ * flag the watched pages among len bytes from adr on, 1 if there were any
+ */
+static inline int aot_watch_range(uint8_t *watch, uint16_t adr, uint32_t len){
+  int hit = 0;
+  uint32_t last = len < MEMORY_SIZE ? adr + len - 1 : adr + MEMORY_SIZE - 1;
+  for(uint32_t page = adr >> 8; page <= last >> 8; page++){
+    if(watch[page & 0xff]){
+      watch[page & 0xff] = AOT_WRITTEN;
+      hit = 1;
+    }
+  }
+  return hit;
+}
+
+/*
+ * run the loop at r->pc as one idiom_run(), returns its cycles or 0 when
+ * the passes have to be stepped instead
+ */
+static inline int aot_idiom(AotRegs *r, const Idiom *idiom, int budget, uint64_t *count){
+  if(!idiom_enabled){
+    return 0;
+  }
+  uint16_t written;
+  AOT_STORE(*r, r->state);
+  uint32_t passes = idiom_run(idiom, r->state, budget, &written);
+  if(passes == 0){
+    return 0;
+  }
+  AOT_LOAD(*r, r->state);
+  if(aot_watch_range(r->watch, written, passes)){
+    r->touched = 1;
+  }
+  *count += passes * idiom->instructions;
+  return passes * idiom->cycles;
+}
+
+/*
+ * Written by recompile: run translated blocks from state->pc until at
+ * least budget cycles have passed, checking the budget at block ends.
+ * Addresses without a block (RAM, PCHL targets, the middle of a block)
+ * go one instruction at a time through emulate(). Returns early right
+ * after an EI or an OUT, as emulate_batch() does. Adds the instructions
+ * executed to *instructions and returns the cycles. Only valid while
+ * memory holds the ROM it was generated from, aot_rom_checksum as
+ * computed by romindex_checksum()
+ */
+int aot_run(State8080 *state, int budget, uint64_t *instructions);
+
+/*
+ * the same, but only through blocks whose gate byte is set, returning at
+ * the first pc that has no open block instead of interpreting it. It also
+ * returns after an instruction that wrote to a watched page or was EI
+ * or OUT, with *touched set
+ */
+int aot_run_gated(State8080 *state, int budget, uint64_t *instructions, const uint8_t *gate, uint8_t *watch, int *touched);
+
+// a translated block
+typedef struct AotBlock {
+  uint16_t start;
+  uint16_t end;
+} AotBlock;
+
+extern const AotBlock aot_blocks[];
+
+extern const int aot_block_count;
+
+extern const uint32_t aot_rom_size;
+
+extern const uint32_t aot_rom_checksum;
+
+#endif
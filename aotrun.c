@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "emulator.h"
+#include "rom.h"
+#include "machine.h"
+#include "romindex.h"
+#include "cores.h"
+#include "aot.h"
+#include "tier.h"
+#include "hash.h"
+
+/*
+ * Runs Invaders on the translated ROM (aot.h) and the tiered engine
+ * (tier.h) and compares them with the interpreters: -v checks every half
+ * frame of both against emulate(), otherwise it times the same frames on
+ * emulate(), emulate_batch(), aot_run() and tier_run(), -s adds the tier
+ * and idiom counters, -i steps copy and fill loops instead of running
+ * them in bulk. Every engine runs as a core of a Machine, so interrupts
+ * come from its scheduler as in run. The faster engines check the budget
+ * at block ends, so an event can reach them a block later than emulate();
+ * -v therefore has emulate() replay each slice the engine ran, as many
+ * instructions long, and the two schedulers see the same boundaries
+ */
+
+enum { RUN_EMULATE, RUN_BATCH, RUN_AOT, RUN_TIERED };
+
+static const char *run_names[] = {"emulate", "batch", "aot", "tiered"};
+
+// promotion thresholds of the tiered engine
+static uint32_t predecode_threshold = 16;
+static uint32_t translate_threshold = 256;
+
+// what the cores below count into and the tiered engine they run on
+static uint64_t instructions;
+static Tiering *tiering;
+
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-r rom_folder] [-f frames] [-v] [-s] [-i] [-p predecode_hits] [-t translate_hits]\n", name);
+  exit(1);
+}
+
+static double now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * emulate() an instruction at a time, ending where a BatchCore has to
+ */
+static int emulate_core(State8080 *state, int budget){
+  int cycles = 0;
+  do {
+    cycles += emulate(state);
+    instructions++;
+  } while(cycles < budget && !state->int_delay && !state->out_written);
+  return cycles;
+}
+
+static int aot_core(State8080 *state, int budget){
+  return aot_run(state, budget, &instructions);
+}
+
+static int tier_core(State8080 *state, int budget){
+  return tier_run(tiering, state, budget, &instructions);
+}
+
+static const BatchCore run_cores[] = {emulate_core, emulate_batch, aot_core, tier_core};
+
+// the instructions of each slice the engine ran, for emulate() to replay
+static BatchCore recorded;
+static uint32_t *slices;
+static size_t slice_count;
+static size_t slice_size;
+static size_t slice_next;
+
+static int record_core(State8080 *state, int budget){
+  uint64_t before = instructions;
+  int cycles = recorded(state, budget);
+  if(slice_count == slice_size){
+    slice_size = slice_size ? slice_size * 2 : 1024;
+    slices = (uint32_t *) realloc(slices, slice_size * sizeof(*slices));
+  }
+  slices[slice_count++] = instructions - before;
+  return cycles;
+}
+
+static int replay_core(State8080 *state, int budget){
+  // past the slices the engine ran the two have differed already
+  uint32_t count = slice_next < slice_count ? slices[slice_next++] : 1;
+  int cycles = 0;
+  for(uint32_t i = 0; i < count; i++){
+    cycles += emulate(state);
+  }
+  return cycles;
+}
+
+/*
+ * run the engine and emulate() on machines of their own to the end of
+ * each half frame and compare registers, memory and cycles. Returns the
+ * half frame they differ in or -1
+ */
+static long verify(int engine, MachinePool *pool, long frames){
+  Machine *machine = machine_create(pool);
+  Machine *expect = machine_create(pool);
+  tiering = tier_create(pool->image, predecode_threshold, translate_threshold);
+  recorded = run_cores[engine];
+  long bad = -1;
+  for(long half = 0; half < frames * 2; half++){
+    uint64_t until = (half + 1) * (INVADERS_FRAME_CYCLES / 2);
+    slice_count = 0;
+    slice_next = 0;
+    machine_run(machine, record_core, until);
+    machine_run(expect, replay_core, until);
+    if(state_signature(&machine->state) != state_signature(&expect->state) || machine->sched.now != expect->sched.now ||
+       hash_ram(machine->state.memory) != hash_ram(expect->state.memory)){
+      bad = half;
+      break;
+    }
+  }
+  tier_free(tiering);
+  machine_release(machine);
+  machine_release(expect);
+  return bad;
+}
+
+int main(int argc, char **argv){
+  char *folder = "rom";
+  long frames = 600;
+  int check = 0;
+  int show_tiers = 0;
+  int opt;
+  while((opt = getopt(argc, argv, "r:f:vsip:t:")) != -1){
+    switch(opt){
+      case 'r':
+        folder = optarg;
+        break;
+      case 'f':
+        frames = atol(optarg);
+        break;
+      case 'v':
+        check = 1;
+        break;
+      case 's':
+        show_tiers = 1;
+        break;
+      case 'i':
+        idiom_enabled = 0;
+        break;
+      case 'p':
+        predecode_threshold = atol(optarg);
+        break;
+      case 't':
+        translate_threshold = atol(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  uint8_t *image = (uint8_t *) calloc(MEMORY_ALLOC, 1);
+  load_invaders(image, folder);
+  if(romindex_checksum(image, aot_rom_size) != aot_rom_checksum){
+    fprintf(stderr, "the translated code was generated from another ROM\n");
+    return 1;
+  }
+
+  MachinePool *pool = machine_pool_create(image, INVADERS_ROM_SIZE, 2);
+  free(image);
+  if(check){
+    int status = 0;
+    for(int engine = RUN_AOT; engine <= RUN_TIERED; engine++){
+      long bad = verify(engine, pool, frames);
+      if(bad >= 0){
+        printf("%s differs from emulate in half frame %ld\n", run_names[engine], bad);
+        status = 1;
+      }
+      else {
+        printf("%s matches emulate over %ld frames\n", run_names[engine], frames);
+      }
+    }
+    machine_pool_free(pool);
+    return status;
+  }
+
+  double base = 0;
+  printf("%-8s %12s %12s %10s %10s %9s\n", "engine", "instructions", "cycles", "seconds", "MHz", "speedup");
+  tiering = tier_create(pool->image, predecode_threshold, translate_threshold);
+  for(int engine = RUN_EMULATE; engine <= RUN_TIERED; engine++){
+    Machine *machine = machine_create(pool);
+    instructions = 0;
+    double start = now();
+    uint64_t cycles = machine_run(machine, run_cores[engine], frames * INVADERS_FRAME_CYCLES);
+    double seconds = now() - start;
+    machine_release(machine);
+    double mhz = cycles / seconds / 1e6;
+    if(engine == RUN_EMULATE){
+      base = mhz;
+    }
+    if(engine == RUN_BATCH){
+      printf("%-8s %12s %12llu %10.4f %10.1f %8.2fx\n", run_names[engine], "-",
+             (unsigned long long) cycles, seconds, mhz, mhz / base);
+    }
+    else {
+      printf("%-8s %12llu %12llu %10.4f %10.1f %8.2fx\n", run_names[engine], (unsigned long long) instructions,
+             (unsigned long long) cycles, seconds, mhz, mhz / base);
+    }
+  }
+  if(show_tiers){
+    printf("\n");
+    tier_report(tiering, stdout, 16);
+    printf("\nidioms: %llu runs, %llu passes, %llu declined\n", (unsigned long long) idiom_stats.runs,
+           (unsigned long long) idiom_stats.passes, (unsigned long long) idiom_stats.declined);
+  }
+  tier_free(tiering);
+  machine_pool_free(pool);
+  return 0;
+}
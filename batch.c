@@ -0,0 +1,55 @@
+#include "batch.h"
+
+/*
+ * Batched execution: the registers and flags are loaded into locals when
+ * a batch starts and stored back when it ends, so the compiler can keep
+ * them in host registers across instructions instead of going through
+ * State8080 for every access. The handlers are macros over those locals
+ * (batch.h), shared with the code the recompiler generates.
+ * It executes exactly what emulate() does, one instruction at a time.
+ */
+
+/*
+ * run instructions until at least budget cycles have passed or up to and
+ * including an EI or OUT, returns the cycles run. A budget of 1 runs a single
+ * instruction
+ */
+int emulate_batch(State8080 *state, int budget){
+  uint8_t *memory = state->memory;
+  uint16_t pc = state->pc;
+  uint16_t sp = state->sp;
+  uint16_t bc = state->bc;
+  uint16_t de = state->de;
+  uint16_t hl = state->hl;
+  uint8_t a = state->a;
+  uint8_t z = state->cc.z;
+  uint8_t s = state->cc.s;
+  uint8_t p = state->cc.p;
+  uint8_t cy = state->cc.cy;
+  uint8_t ac = state->cc.ac;
+  int cycles = 0;
+  state->int_delay = 0;
+
+  while(cycles < budget){
+    uint8_t opcode = MEMORY_FETCH(memory, pc);
+    cycles += opcode_cycles[opcode];
+    pc++;
+
+    switch(opcode){
+#include "batch_cases.h"
+    }
+  }
+
+  state->pc = pc;
+  state->sp = sp;
+  state->bc = bc;
+  state->de = de;
+  state->hl = hl;
+  state->a = a;
+  state->cc.z = z;
+  state->cc.s = s;
+  state->cc.p = p;
+  state->cc.cy = cy;
+  state->cc.ac = ac;
+  return cycles;
+}
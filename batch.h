@@ -0,0 +1,92 @@
+#ifndef __BATCH__
+#define __BATCH__
+
+#include "emulator.h"
+#include "opcodes.h"
+
+/*
+ * Instruction handlers over registers held in locals. Code using them
+ * declares memory, pc, sp, bc, de, hl, a, the flags z s p cy ac, cycles,
+ * budget and state, then expands batch_cases.h inside a switch on the
+ * opcode (or redefines the macros that use them, as aot.h does).
+ * The opcode fetch and its opcode_cycles[] cost are the caller's, the
+ * handlers read their operands at pc and add only the extra cycles of a
+ * taken conditional call or return
+ */
+
+// 1 for bytes with an even number of set bits
+#define P2(n) n, n ^ 1, n ^ 1, n
+#define P4(n) P2(n), P2(n ^ 1), P2(n ^ 1), P2(n)
+#define P6(n) P4(n), P4(n ^ 1), P4(n ^ 1), P4(n)
+static const uint8_t even_parity[256] = {P6(1), P6(0), P6(0), P6(1)};
+
+#define READ(adr) MEMORY_READ(memory, adr)
+#define WRITE(adr, val) do { uint16_t wa_ = (adr); uint8_t wv_ = (val); \
+    if(memory_writable(state, wa_)) MEMORY_WRITE(memory, wa_, wv_); } while(0)
+
+#define HI(pair) ((uint8_t) ((pair) >> 8))
+#define LO(pair) ((uint8_t) (pair))
+#define SET_HI(pair, val) ((pair) = ((pair) & 0x00ff) | (uint8_t) (val) << 8)
+#define SET_LO(pair, val) ((pair) = ((pair) & 0xff00) | (uint8_t) (val))
+
+#define IMM8() READ(pc++)
+#define FETCH_WORD(dst) do { (dst) = READ(pc) | READ(pc + 1) << 8; pc += 2; } while(0)
+
+#define ZSP(val) do { uint8_t v_ = (val); z = v_ == 0; s = v_ >> 7; p = even_parity[v_]; } while(0)
+
+#define ADD(x) do { uint8_t x_ = (x); uint16_t r_ = a + x_; \
+    ac = ((a & 0x0f) + (x_ & 0x0f)) > 0x0f; cy = r_ > 0xff; a = r_; ZSP(a); } while(0)
+#define ADC(x) do { uint8_t x_ = (x); uint16_t r_ = a + x_ + cy; \
+    ac = ((a & 0x0f) + (x_ & 0x0f) + cy) > 0x0f; cy = r_ > 0xff; a = r_; ZSP(a); } while(0)
+#define SUB(x) do { uint8_t x_ = (x); uint16_t r_ = a - x_; \
+    ac = ((a & 0x0f) + (~x_ & 0x0f) + 1) > 0x0f; cy = r_ > 0xff; a = r_; ZSP(a); } while(0)
+#define SBB(x) do { uint8_t x_ = (x); uint16_t r_ = a - x_ - cy; \
+    ac = ((a & 0x0f) + (~x_ & 0x0f) + !cy) > 0x0f; cy = r_ > 0xff; a = r_; ZSP(a); } while(0)
+#define ANA(x) do { uint8_t x_ = (x); ac = ((a | x_) & 0x08) != 0; a &= x_; cy = 0; ZSP(a); } while(0)
+#define XRA(x) do { a ^= (x); ac = 0; cy = 0; ZSP(a); } while(0)
+#define ORA(x) do { a |= (x); ac = 0; cy = 0; ZSP(a); } while(0)
+#define CMP(x) do { uint8_t x_ = (x); uint16_t r_ = a - x_; \
+    ac = ((a & 0x0f) + (~x_ & 0x0f) + 1) > 0x0f; cy = r_ > 0xff; ZSP(r_); } while(0)
+
+#define INR_FLAGS(val) do { uint8_t n_ = (val); ac = (n_ & 0x0f) == 0; ZSP(n_); } while(0)
+#define DCR_FLAGS(val) do { uint8_t n_ = (val); ac = (n_ & 0x0f) != 0x0f; ZSP(n_); } while(0)
+#define DAD(pair) do { uint32_t sum_ = hl + (pair); cy = sum_ >> 16; hl = sum_; } while(0)
+
+#define PUSH(word) do { uint16_t w_ = (word); sp -= 2; WRITE(sp, w_ & 0xff); WRITE(sp + 1, w_ >> 8); } while(0)
+#define POP(dst) do { (dst) = READ(sp) | READ(sp + 1) << 8; sp += 2; } while(0)
+#define JMP() do { uint16_t adr_; FETCH_WORD(adr_); pc = adr_; } while(0)
+#define CALL() do { uint16_t adr_; FETCH_WORD(adr_); PUSH(pc); pc = adr_; } while(0)
+#define RST(adr) do { PUSH(pc); pc = (adr); } while(0)
+// the batch ends right after EI, where interrupt_service() handles its delay
+#define EI() do { state->int_enable = 1; state->int_delay = 1; budget = 0; } while(0)
+// and after OUT, so the device sees the write at its cycle
+#define OUT(port) do { state->out_port = (port); state->out_value = a; state->out_written = 1; budget = 0; } while(0)
+#define JMP_IF(cond) do { uint16_t adr_; FETCH_WORD(adr_); if(cond) pc = adr_; } while(0)
+#define CALL_IF(cond) do { uint16_t adr_; FETCH_WORD(adr_); \
+    if(cond){ PUSH(pc); pc = adr_; cycles += COND_TAKEN_CYCLES; } } while(0)
+#define RET_IF(cond) do { if(cond){ POP(pc); cycles += COND_TAKEN_CYCLES; } } while(0)
+
+// register operands of the MOV and ALU blocks by field name
+#define GET_b HI(bc)
+#define GET_c LO(bc)
+#define GET_d HI(de)
+#define GET_e LO(de)
+#define GET_h HI(hl)
+#define GET_l LO(hl)
+#define GET_m READ(hl)
+#define GET_a a
+#define SET_b(val) SET_HI(bc, val)
+#define SET_c(val) SET_LO(bc, val)
+#define SET_d(val) SET_HI(de, val)
+#define SET_e(val) SET_LO(de, val)
+#define SET_h(val) SET_HI(hl, val)
+#define SET_l(val) SET_LO(hl, val)
+#define SET_m(val) WRITE(hl, val)
+#define SET_a(val) a = (val)
+
+#define MOV_CASE(d, s, dst, src) case 0x40 | (d) << 3 | (s): if((d) != 6 || (s) != 6) SET_##dst(GET_##src); break;
+#define MOV_ROW(d, dst) SOURCES(MOV_CASE, d, dst)
+#define ALU_CASE(o, s, OP, src) case 0x80 | (o) << 3 | (s): OP(GET_##src); break;
+#define ALU_ROW(o, op, OP) SOURCES(ALU_CASE, o, OP)
+
+#endif
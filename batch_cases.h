@@ -0,0 +1,174 @@
+/*
+ * one case per opcode of the batch.h handlers, expanded inside a switch
+ * by every user (no include guard)
+ */
+    case 0x00: break; // NOP
+    case 0x01: FETCH_WORD(bc); break; // LXI B
+    case 0x02: WRITE(bc, a); break; // STAX B
+    case 0x03: bc++; break; // INX B
+    case 0x04: SET_HI(bc, HI(bc) + 1); INR_FLAGS(HI(bc)); break; // INR B
+    case 0x05: SET_HI(bc, HI(bc) - 1); DCR_FLAGS(HI(bc)); break; // DCR B
+    case 0x06: SET_HI(bc, IMM8()); break; // MVI B
+    case 0x07: cy = a >> 7; a = (a << 1) | cy; break; // RLC
+    case 0x08: break; // *NOP
+    case 0x09: DAD(bc); break; // DAD B
+    case 0x0a: a = READ(bc); break; // LDAX B
+    case 0x0b: bc--; break; // DCX B
+    case 0x0c: SET_LO(bc, LO(bc) + 1); INR_FLAGS(LO(bc)); break; // INR C
+    case 0x0d: SET_LO(bc, LO(bc) - 1); DCR_FLAGS(LO(bc)); break; // DCR C
+    case 0x0e: SET_LO(bc, IMM8()); break; // MVI C
+    case 0x0f: cy = a & 1; a = (a >> 1) | (cy << 7); break; // RRC
+
+    case 0x10: break; // *NOP
+    case 0x11: FETCH_WORD(de); break; // LXI D
+    case 0x12: WRITE(de, a); break; // STAX D
+    case 0x13: de++; break; // INX D
+    case 0x14: SET_HI(de, HI(de) + 1); INR_FLAGS(HI(de)); break; // INR D
+    case 0x15: SET_HI(de, HI(de) - 1); DCR_FLAGS(HI(de)); break; // DCR D
+    case 0x16: SET_HI(de, IMM8()); break; // MVI D
+    case 0x17: { uint8_t carry = cy; cy = a >> 7; a = (a << 1) | carry; break; } // RAL
+    case 0x18: break; // *NOP
+    case 0x19: DAD(de); break; // DAD D
+    case 0x1a: a = READ(de); break; // LDAX D
+    case 0x1b: de--; break; // DCX D
+    case 0x1c: SET_LO(de, LO(de) + 1); INR_FLAGS(LO(de)); break; // INR E
+    case 0x1d: SET_LO(de, LO(de) - 1); DCR_FLAGS(LO(de)); break; // DCR E
+    case 0x1e: SET_LO(de, IMM8()); break; // MVI E
+    case 0x1f: { uint8_t carry = cy; cy = a & 1; a = (a >> 1) | (carry << 7); break; } // RAR
+
+    case 0x20: break; // *NOP
+    case 0x21: FETCH_WORD(hl); break; // LXI H
+    case 0x22: { uint16_t adr; FETCH_WORD(adr); WRITE(adr, LO(hl)); WRITE(adr + 1, HI(hl)); break; } // SHLD
+    case 0x23: hl++; break; // INX H
+    case 0x24: SET_HI(hl, HI(hl) + 1); INR_FLAGS(HI(hl)); break; // INR H
+    case 0x25: SET_HI(hl, HI(hl) - 1); DCR_FLAGS(HI(hl)); break; // DCR H
+    case 0x26: SET_HI(hl, IMM8()); break; // MVI H
+    case 0x27: { // DAA
+      uint8_t correction = 0;
+      uint8_t carry = cy;
+      if((a & 0x0f) > 9 || ac){
+        correction |= 0x06;
+      }
+      if((a >> 4) > 9 || cy || ((a >> 4) >= 9 && (a & 0x0f) > 9)){
+        correction |= 0x60;
+        carry = 1;
+      }
+      ADD(correction);
+      cy = carry;
+      break;
+    }
+    case 0x28: break; // *NOP
+    case 0x29: DAD(hl); break; // DAD H
+    case 0x2a: { uint16_t adr; FETCH_WORD(adr); hl = READ(adr) | READ(adr + 1) << 8; break; } // LHLD
+    case 0x2b: hl--; break; // DCX H
+    case 0x2c: SET_LO(hl, LO(hl) + 1); INR_FLAGS(LO(hl)); break; // INR L
+    case 0x2d: SET_LO(hl, LO(hl) - 1); DCR_FLAGS(LO(hl)); break; // DCR L
+    case 0x2e: SET_LO(hl, IMM8()); break; // MVI L
+    case 0x2f: a = ~a; break; // CMA
+
+    case 0x30: break; // *NOP
+    case 0x31: FETCH_WORD(sp); break; // LXI SP
+    case 0x32: { uint16_t adr; FETCH_WORD(adr); WRITE(adr, a); break; } // STA
+    case 0x33: sp++; break; // INX SP
+    case 0x34: { uint8_t val = READ(hl) + 1; WRITE(hl, val); INR_FLAGS(val); break; } // INR M
+    case 0x35: { uint8_t val = READ(hl) - 1; WRITE(hl, val); DCR_FLAGS(val); break; } // DCR M
+    case 0x36: WRITE(hl, IMM8()); break; // MVI M
+    case 0x37: cy = 1; break; // STC
+    case 0x38: break; // *NOP
+    case 0x39: DAD(sp); break; // DAD SP
+    case 0x3a: { uint16_t adr; FETCH_WORD(adr); a = READ(adr); break; } // LDA
+    case 0x3b: sp--; break; // DCX SP
+    case 0x3c: a++; INR_FLAGS(a); break; // INR A
+    case 0x3d: a--; DCR_FLAGS(a); break; // DCR A
+    case 0x3e: a = IMM8(); break; // MVI A
+    case 0x3f: cy = !cy; break; // CMC
+
+    // 0x40 - 0x7f: MOV dst,src, except 0x76 where MOV M,M would be is HLT
+    REGISTERS(MOV_ROW)
+
+    // 0x80 - 0xbf: ALU operation on A and src
+    ALU_OPS(ALU_ROW)
+
+    case 0xc0: RET_IF(!z); break; // RNZ
+    case 0xc1: POP(bc); break; // POP B
+    case 0xc2: JMP_IF(!z); break; // JNZ
+    case 0xc3: JMP(); break; // JMP
+    case 0xc4: CALL_IF(!z); break; // CNZ
+    case 0xc5: PUSH(bc); break; // PUSH B
+    case 0xc6: ADD(IMM8()); break; // ADI
+    case 0xc7: RST(0x00); break; // RST 0
+    case 0xc8: RET_IF(z); break; // RZ
+    case 0xc9: POP(pc); break; // RET
+    case 0xca: JMP_IF(z); break; // JZ
+    case 0xcb: JMP(); break; // *JMP
+    case 0xcc: CALL_IF(z); break; // CZ
+    case 0xcd: CALL(); break; // CALL
+    case 0xce: ADC(IMM8()); break; // ACI
+    case 0xcf: RST(0x08); break; // RST 1
+
+    case 0xd0: RET_IF(!cy); break; // RNC
+    case 0xd1: POP(de); break; // POP D
+    case 0xd2: JMP_IF(!cy); break; // JNC
+    case 0xd3: OUT(IMM8()); break; // OUT
+    case 0xd4: CALL_IF(!cy); break; // CNC
+    case 0xd5: PUSH(de); break; // PUSH D
+    case 0xd6: SUB(IMM8()); break; // SUI
+    case 0xd7: RST(0x10); break; // RST 2
+    case 0xd8: RET_IF(cy); break; // RC
+    case 0xd9: POP(pc); break; // *RET
+    case 0xda: JMP_IF(cy); break; // JC
+    case 0xdb: pc++; break; // IN, no devices yet
+    case 0xdc: CALL_IF(cy); break; // CC
+    case 0xdd: CALL(); break; // *CALL
+    case 0xde: SBB(IMM8()); break; // SBI
+    case 0xdf: RST(0x18); break; // RST 3
+
+    case 0xe0: RET_IF(!p); break; // RPO
+    case 0xe1: POP(hl); break; // POP H
+    case 0xe2: JMP_IF(!p); break; // JPO
+    case 0xe3: { // XTHL
+      uint16_t top = READ(sp) | READ(sp + 1) << 8;
+      WRITE(sp, LO(hl));
+      WRITE(sp + 1, HI(hl));
+      hl = top;
+      break;
+    }
+    case 0xe4: CALL_IF(!p); break; // CPO
+    case 0xe5: PUSH(hl); break; // PUSH H
+    case 0xe6: ANA(IMM8()); break; // ANI
+    case 0xe7: RST(0x20); break; // RST 4
+    case 0xe8: RET_IF(p); break; // RPE
+    case 0xe9: pc = hl; break; // PCHL
+    case 0xea: JMP_IF(p); break; // JPE
+    case 0xeb: { uint16_t t = de; de = hl; hl = t; break; } // XCHG
+    case 0xec: CALL_IF(p); break; // CPE
+    case 0xed: CALL(); break; // *CALL
+    case 0xee: XRA(IMM8()); break; // XRI
+    case 0xef: RST(0x28); break; // RST 5
+
+    case 0xf0: RET_IF(!s); break; // RP
+    case 0xf1: { // POP PSW
+      uint16_t psw;
+      POP(psw);
+      a = psw >> 8;
+      s = (psw >> 7) & 1;
+      z = (psw >> 6) & 1;
+      ac = (psw >> 4) & 1;
+      p = (psw >> 2) & 1;
+      cy = psw & 1;
+      break;
+    }
+    case 0xf2: JMP_IF(!s); break; // JP
+    case 0xf3: state->int_enable = 0; break; // DI
+    case 0xf4: CALL_IF(!s); break; // CP
+    case 0xf5: PUSH(a << 8 | s << 7 | z << 6 | ac << 4 | p << 2 | 0x02 | cy); break; // PUSH PSW
+    case 0xf6: ORA(IMM8()); break; // ORI
+    case 0xf7: RST(0x30); break; // RST 6
+    case 0xf8: RET_IF(s); break; // RM
+    case 0xf9: sp = hl; break; // SPHL
+    case 0xfa: JMP_IF(s); break; // JM
+    case 0xfb: EI(); break; // EI
+    case 0xfc: CALL_IF(s); break; // CM
+    case 0xfd: CALL(); break; // *CALL
+    case 0xfe: CMP(IMM8()); break; // CPI
+    case 0xff: RST(0x38); break; // RST 7
@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "emulator.h"
+#include "rom.h"
+#include "machine.h"
+#include "hash.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+// instructions in one pass of a microbenchmark loop, before the jump back
+#define LOOP_BODY 240
+
+typedef struct Result {
+  const char *name;
+  // timed with emulate_batch() rather than emulate()
+  int batch;
+  uint64_t instructions;
+  uint64_t cycles;
+  double seconds;
+  double tsc;
+} Result;
+
+static double now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t ticks(void){
+#ifdef HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/*
+ * clear the registers and point the state at memory
+ */
+static void reset(State8080 *state, uint8_t *memory){
+  memset(state, 0, sizeof(*state));
+  state->memory = memory;
+}
+
+/*
+ * emulate instructions until at least budget cycles have passed, the
+ * batched core does not count instructions, main() fills them in
+ */
+static void run_cycles(State8080 *state, uint64_t budget, Result *result){
+  uint64_t cycles = 0;
+  if(result->batch){
+    // it returns early after every EI
+    while(cycles < budget){
+      cycles += emulate_batch(state, budget - cycles);
+    }
+    result->cycles += cycles;
+    return;
+  }
+  uint64_t instructions = 0;
+  while(cycles < budget){
+    cycles += emulate(state);
+    instructions++;
+  }
+  result->cycles += cycles;
+  result->instructions += instructions;
+}
+
+/*
+ * write a loop at 0x0000 that repeats body to about LOOP_BODY instructions,
+ * then jumps back to the start
+ */
+static void build_loop(uint8_t *memory, const uint8_t *body, int body_len, int per_body){
+  int pc = 0;
+  for(int i = 0; i < LOOP_BODY / per_body; i++){
+    memcpy(memory + pc, body, body_len);
+    pc += body_len;
+  }
+  memory[pc] = 0xc3;
+  memory[pc + 1] = 0x00;
+  memory[pc + 2] = 0x00;
+}
+
+/*
+ * fill memory with the microbenchmark for one opcode class, returns 0 for
+ * an unknown class
+ */
+static int build_micro(const char *name, uint8_t *memory){
+  uint8_t body[256];
+  int len = 0;
+
+  memset(memory, 0, MEMORY_ALLOC);
+  if(strcmp(name, "mov") == 0){
+    // everything but HLT and the moves into H and L, so M stays in RAM
+    for(int op = 0x40; op < 0x80; op++){
+      if(op != 0x76 && (op & 0xf0) != 0x60){
+        body[len++] = op;
+      }
+    }
+    build_loop(memory, body, len, len);
+  }
+  else if(strcmp(name, "alu") == 0){
+    for(int op = 0x80; op < 0xc0; op++){
+      body[len++] = op;
+    }
+    build_loop(memory, body, len, len);
+  }
+  else if(strcmp(name, "branch") == 0){
+    // every jump targets the next instruction, so taken and not taken
+    // conditional jumps both fall through
+    static const uint8_t jumps[] = {0xc2, 0xca, 0xd2, 0xda, 0xe2, 0xea, 0xf2, 0xfa, 0xc3};
+    int pc = 0;
+    for(int count = 0; count < LOOP_BODY; count++){
+      uint16_t next = pc + 3;
+      memory[pc] = jumps[count % sizeof(jumps)];
+      memory[pc + 1] = next & 0xff;
+      memory[pc + 2] = next >> 8;
+      pc = next;
+    }
+    memory[pc] = 0xc3;
+  }
+  else if(strcmp(name, "stack") == 0){
+    // balanced pushes and pops, then a CALL to a RET placed above the loop
+    static const uint8_t ops[] = {0xc5, 0xd5, 0xe5, 0xf5, 0xf1, 0xe1, 0xd1, 0xc1, 0xcd, 0x00, 0x10};
+    build_loop(memory, ops, sizeof(ops), 10);
+    memory[0x1000] = 0xc9;
+  }
+  else if(strcmp(name, "io") == 0){
+    static const uint8_t ops[] = {0xdb, 0x01, 0xd3, 0x03, 0xdb, 0x02, 0xd3, 0x05};
+    build_loop(memory, ops, sizeof(ops), 4);
+  }
+  else {
+    return 0;
+  }
+  memory_sync_guard(memory);
+  return 1;
+}
+
+/*
+ * time budget cycles of the microbenchmark already in memory
+ */
+static void time_micro(uint8_t *memory, uint64_t budget, Result *result){
+  State8080 state;
+  reset(&state, memory);
+  state.sp = 0x3000;
+  state.h = 0x20;
+  state.l = 0x00;
+  double start = now();
+  uint64_t t0 = ticks();
+  run_cycles(&state, budget, result);
+  result->tsc += ticks() - t0;
+  result->seconds += now() - start;
+}
+
+/*
+ * time frames frames of the invaders ROM from reset
+ */
+static void time_invaders(uint8_t *memory, const uint8_t *rom, int frames, Result *result){
+  State8080 state;
+  memcpy(memory, rom, MEMORY_ALLOC);
+  reset(&state, memory);
+  double start = now();
+  uint64_t t0 = ticks();
+  for(int i = 0; i < frames; i++){
+    run_cycles(&state, INVADERS_FRAME_CYCLES, result);
+  }
+  result->tsc += ticks() - t0;
+  result->seconds += now() - start;
+}
+
+/*
+ * seconds per clone and release of an invaders machine a second into
+ * the game, the branching pattern of a search over game states
+ */
+static double time_clone(const uint8_t *rom, int clones){
+  MachinePool *pool = machine_pool_create(rom, INVADERS_ROM_SIZE, 1);
+  Machine *root = machine_create(pool);
+  Result warm;
+  memset(&warm, 0, sizeof(warm));
+  for(int i = 0; i < 60; i++){
+    run_cycles(&root->state, INVADERS_FRAME_CYCLES, &warm);
+  }
+  double start = now();
+  for(int i = 0; i < clones; i++){
+    machine_release(machine_clone(root));
+  }
+  double seconds = (now() - start) / clones;
+  machine_pool_free(pool);
+  return seconds;
+}
+
+/*
+ * nanoseconds per hash of the video RAM and of the whole address space
+ * with one hash loop, to hold against the time a frame takes
+ */
+static void time_hash(const uint8_t *rom, double *vram_ns, double *ram_ns){
+  volatile uint64_t sink = 0;
+  double start = now();
+  for(int i = 0; i < 100000; i++){
+    sink += hash_vram(rom);
+  }
+  *vram_ns = (now() - start) * 1e4;
+  start = now();
+  for(int i = 0; i < 10000; i++){
+    sink += hash_ram(rom);
+  }
+  *ram_ns = (now() - start) * 1e5;
+}
+
+static int by_double(const void *x, const void *y){
+  double a = *(const double *) x;
+  double b = *(const double *) y;
+  return (a > b) - (a < b);
+}
+
+static int by_seconds(const void *x, const void *y){
+  double a = ((const Result *) x)->seconds;
+  double b = ((const Result *) y)->seconds;
+  return (a > b) - (a < b);
+}
+
+static void print_result(FILE *out, Result *r, int json, int last){
+  double ns = r->instructions ? 1e9 * r->seconds / r->instructions : 0;
+  double mhz = r->seconds > 0 ? r->cycles / r->seconds / 1e6 : 0;
+  double ipc = r->tsc > 0 ? r->instructions / r->tsc : 0;
+  if(json){
+    fprintf(out, "    {\"name\": \"%s\", \"core\": \"%s\", \"instructions\": %llu, \"cycles\": %llu, "
+            "\"seconds\": %.9f, \"ns_per_instruction\": %.4f, \"emulated_mhz\": %.3f, "
+            "\"instructions_per_tsc_cycle\": %.4f}%s\n",
+            r->name, r->batch ? "batch" : "emulate", (unsigned long long) r->instructions, (unsigned long long) r->cycles,
+            r->seconds, ns, mhz, ipc, last ? "" : ",");
+  }
+  else {
+    fprintf(out, "%-10s %-8s %12llu %10.4f %12.3f %10.4f\n", r->name, r->batch ? "batch" : "emulate",
+            (unsigned long long) r->instructions, ns, mhz, ipc);
+  }
+}
+
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-r repetitions] [-w warmups] [-c micro_cycles] [-f frames] [-o bench.json]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv){
+  int repetitions = 5;
+  int warmups = 1;
+  uint64_t micro_cycles = 20000000;
+  int frames = 600;
+  char *out_path = "bench.json";
+  int opt;
+  while((opt = getopt(argc, argv, "r:w:c:f:o:")) != -1){
+    switch(opt){
+      case 'r':
+        repetitions = atoi(optarg);
+        break;
+      case 'w':
+        warmups = atoi(optarg);
+        break;
+      case 'c':
+        micro_cycles = atoll(optarg);
+        break;
+      case 'f':
+        frames = atoi(optarg);
+        break;
+      case 'o':
+        out_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if(repetitions < 1){
+    usage(argv[0]);
+  }
+
+  static const char *micros[] = {"mov", "alu", "branch", "stack", "io"};
+  int micro_count = sizeof(micros) / sizeof(*micros);
+  int result_count = 2 * (micro_count + 1);
+  Result results[16];
+  Result *runs = (Result *) calloc(repetitions, sizeof(Result));
+  uint8_t *memory = (uint8_t *) calloc(MEMORY_ALLOC, 1);
+  uint8_t *rom = (uint8_t *) calloc(MEMORY_ALLOC, 1);
+  load_invaders(rom, "rom");
+
+  // each benchmark keeps the median of its timed repetitions, once per core
+  for(int k = 0; k < result_count; k++){
+    int b = k / 2;
+    for(int i = -warmups; i < repetitions; i++){
+      Result *r = &runs[i < 0 ? 0 : i];
+      memset(r, 0, sizeof(*r));
+      r->batch = k & 1;
+      if(b < micro_count){
+        r->name = micros[b];
+        build_micro(micros[b], memory);
+        time_micro(memory, micro_cycles, r);
+      }
+      else {
+        r->name = "invaders";
+        time_invaders(memory, rom, frames, r);
+      }
+    }
+    qsort(runs, repetitions, sizeof(Result), by_seconds);
+    results[k] = runs[repetitions / 2];
+    // both cores run the same instructions for the same cycle budget
+    if(results[k].batch){
+      results[k].instructions = results[k - 1].instructions;
+    }
+  }
+
+  double *clone_runs = (double *) calloc(repetitions, sizeof(double));
+  for(int i = -warmups; i < repetitions; i++){
+    clone_runs[i < 0 ? 0 : i] = time_clone(rom, 100000);
+  }
+  qsort(clone_runs, repetitions, sizeof(double), by_double);
+  double clone_seconds = clone_runs[repetitions / 2];
+
+  // each hash loop the CPU has, the default one put back after
+  static const char *hashes[] = {"scalar", "sse2", "avx2"};
+  const char *hash_names[3];
+  double hash_vram_ns[3];
+  double hash_ram_ns[3];
+  int hash_count = 0;
+  const char *hash_default = hash_implementation();
+  double *vram_runs = (double *) calloc(repetitions, sizeof(double));
+  double *ram_runs = (double *) calloc(repetitions, sizeof(double));
+  for(int h = 0; h < 3; h++){
+    if(hash_use(hashes[h]) != 0){
+      continue;
+    }
+    for(int i = -warmups; i < repetitions; i++){
+      time_hash(rom, &vram_runs[i < 0 ? 0 : i], &ram_runs[i < 0 ? 0 : i]);
+    }
+    qsort(vram_runs, repetitions, sizeof(double), by_double);
+    qsort(ram_runs, repetitions, sizeof(double), by_double);
+    hash_names[hash_count] = hashes[h];
+    hash_vram_ns[hash_count] = vram_runs[repetitions / 2];
+    hash_ram_ns[hash_count] = ram_runs[repetitions / 2];
+    hash_count++;
+  }
+  hash_use(hash_default);
+
+  printf("%-10s %-8s %12s %10s %12s %10s\n", "benchmark", "core", "instructions", "ns/instr", "emul MHz", "instr/tsc");
+  for(int k = 0; k < result_count; k++){
+    print_result(stdout, &results[k], 0, 0);
+  }
+  printf("clone               %10.1f ns %12.0f clones/s\n", 1e9 * clone_seconds, 1 / clone_seconds);
+  // against an invaders frame on the batch core, the last result
+  double frame_ns = 1e9 * results[result_count - 1].seconds / frames;
+  for(int h = 0; h < hash_count; h++){
+    printf("hash %-6s%s  vram %8.1f ns %6.2f%% of a frame, ram %8.1f ns\n", hash_names[h],
+           strcmp(hash_names[h], hash_default) == 0 ? "*" : " ", hash_vram_ns[h], 100 * hash_vram_ns[h] / frame_ns,
+           hash_ram_ns[h]);
+  }
+
+  FILE *f = fopen(out_path, "w");
+  if(f == NULL){
+    fprintf(stderr, "could not write %s\n", out_path);
+    return 1;
+  }
+  fprintf(f, "{\n  \"repetitions\": %d,\n  \"warmups\": %d,\n  \"micro_cycles\": %llu,\n"
+          "  \"invaders_frames\": %d,\n  \"clone_ns\": %.1f,\n  \"results\": [\n",
+          repetitions, warmups, (unsigned long long) micro_cycles, frames, 1e9 * clone_seconds);
+  for(int k = 0; k < result_count; k++){
+    print_result(f, &results[k], 1, k == result_count - 1);
+  }
+  fprintf(f, "  ],\n  \"hash\": [\n");
+  for(int h = 0; h < hash_count; h++){
+    fprintf(f, "    {\"implementation\": \"%s\", \"default\": %s, \"vram_ns\": %.1f, \"ram_ns\": %.1f}%s\n",
+            hash_names[h], strcmp(hash_names[h], hash_default) == 0 ? "true" : "false", hash_vram_ns[h],
+            hash_ram_ns[h], h == hash_count - 1 ? "" : ",");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+
+  free(runs);
+  free(vram_runs);
+  free(ram_runs);
+  free(clone_runs);
+  free(memory);
+  free(rom);
+  return 0;
+}
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "callstack.h"
+#include "opcodes.h"
+
+/*
+ * hash a (parent, routine) edge of the calling context tree
+ */
+static uint32_t edge_hash(int32_t parent, uint16_t routine){
+  uint32_t h = (uint32_t) parent * 0x9e3779b1u ^ routine * 0x85ebca6bu;
+  return h ^ (h >> 15);
+}
+
+/*
+ * double the child lookup table and reinsert every non root node
+ */
+static void grow_children(CallStack *stack){
+  uint32_t size = (stack->children_mask + 1) * 2;
+  free(stack->children);
+  stack->children = (int32_t *) malloc(size * sizeof(*stack->children));
+  memset(stack->children, 0xff, size * sizeof(*stack->children));
+  stack->children_mask = size - 1;
+  for(int32_t i = 1; i < stack->node_count; i++){
+    uint32_t slot = edge_hash(stack->nodes[i].parent, stack->nodes[i].routine) & stack->children_mask;
+    while(stack->children[slot] >= 0){
+      slot = (slot + 1) & stack->children_mask;
+    }
+    stack->children[slot] = i;
+  }
+}
+
+/*
+ * find or create the node for routine called from parent
+ */
+static int32_t child_node(CallStack *stack, int32_t parent, uint16_t routine){
+  uint32_t slot = edge_hash(parent, routine) & stack->children_mask;
+  while(stack->children[slot] >= 0){
+    CallNode *node = &stack->nodes[stack->children[slot]];
+    if(node->parent == parent && node->routine == routine){
+      return stack->children[slot];
+    }
+    slot = (slot + 1) & stack->children_mask;
+  }
+
+  if(stack->node_count == stack->node_capacity){
+    stack->node_capacity *= 2;
+    stack->nodes = (CallNode *) realloc(stack->nodes, stack->node_capacity * sizeof(CallNode));
+  }
+  int32_t index = stack->node_count++;
+  CallNode *node = &stack->nodes[index];
+  node->routine = routine;
+  node->parent = parent;
+  node->calls = 0;
+  node->exclusive = 0;
+  stack->children[slot] = index;
+
+  if((uint32_t) stack->node_count * 2 > stack->children_mask){
+    grow_children(stack);
+  }
+  return index;
+}
+
+/*
+ * allocate an empty shadow stack whose bottom frame is the reset entry point
+ */
+CallStack *callstack_create(void){
+  CallStack *stack = (CallStack *) calloc(1, sizeof(CallStack));
+  stack->node_capacity = 1024;
+  stack->nodes = (CallNode *) calloc(stack->node_capacity, sizeof(CallNode));
+  stack->node_count = 1;
+  stack->children_mask = 1023;
+  stack->children = (int32_t *) malloc((stack->children_mask + 1) * sizeof(*stack->children));
+  memset(stack->children, 0xff, (stack->children_mask + 1) * sizeof(*stack->children));
+
+  stack->depth = 1;
+  stack->frames[0].node = 0;
+  stack->frames[0].routine = 0;
+  stack->calls[0] = 1;
+  stack->active[0] = 1;
+  stack->nodes[0].calls = 1;
+  return stack;
+}
+
+void callstack_free(CallStack *stack){
+  free(stack->nodes);
+  free(stack->children);
+  free(stack);
+}
+
+/*
+ * push a call to routine that will come back to return_adr, used for
+ * call instructions and for interrupts
+ */
+void callstack_enter(CallStack *stack, uint16_t routine, uint16_t return_adr){
+  if(stack->depth == CALLSTACK_DEPTH){
+    stack->overflows++;
+    return;
+  }
+  CallFrame *frame = &stack->frames[stack->depth++];
+  frame->node = child_node(stack, stack->frames[stack->depth - 2].node, routine);
+  frame->routine = routine;
+  frame->return_adr = return_adr;
+  frame->entry = stack->now;
+  stack->nodes[frame->node].calls++;
+  stack->calls[routine]++;
+  stack->active[routine]++;
+}
+
+/*
+ * pop the top frame, crediting its inclusive time to the routine unless
+ * an outer activation of the same routine is still running
+ */
+static void leave(CallStack *stack){
+  CallFrame *frame = &stack->frames[--stack->depth];
+  if(--stack->active[frame->routine] == 0){
+    stack->inclusive[frame->routine] += stack->now - frame->entry;
+  }
+}
+
+/*
+ * pop frames up to the one returning to adr, returns that ignore the
+ * shadow stack (computed jumps through the stack) are left alone
+ */
+static void leave_to(CallStack *stack, uint16_t adr){
+  for(int i = stack->depth - 1; i > 0; i--){
+    if(stack->frames[i].return_adr == adr){
+      while(stack->depth > i){
+        leave(stack);
+      }
+      return;
+    }
+  }
+}
+
+/*
+ * account one executed instruction, pc and sp are the values before it ran
+ */
+void callstack_step(CallStack *stack, State8080 *state, uint8_t opcode, uint16_t pc, uint16_t sp, int cycles){
+  CallFrame *top = &stack->frames[stack->depth - 1];
+  stack->now += cycles;
+  stack->nodes[top->node].exclusive += cycles;
+  stack->exclusive[top->routine] += cycles;
+
+  switch(opcode){
+    case 0xcd: case 0xc4: case 0xcc: case 0xd4: case 0xdc:
+    case 0xe4: case 0xec: case 0xf4: case 0xfc:
+    case 0xc7: case 0xcf: case 0xd7: case 0xdf:
+    case 0xe7: case 0xef: case 0xf7: case 0xff:
+    case 0xdd: case 0xed: case 0xfd:
+      if(state->sp == (uint16_t) (sp - 2)){
+        callstack_enter(stack, state->pc, pc + opcode_lengths[opcode]);
+      }
+      break;
+
+    case 0xc9: case 0xc0: case 0xc8: case 0xd0: case 0xd8:
+    case 0xe0: case 0xe8: case 0xf0: case 0xf8:
+    case 0xd9:
+      if(state->sp == (uint16_t) (sp + 2)){
+        leave_to(stack, state->pc);
+      }
+      break;
+  }
+}
+
+/*
+ * end every open call so inclusive totals cover the whole run
+ */
+void callstack_close(CallStack *stack){
+  while(stack->depth > 1){
+    leave(stack);
+  }
+  if(stack->active[0] == 1){
+    stack->active[0] = 0;
+    stack->inclusive[0] += stack->now - stack->frames[0].entry;
+  }
+}
+
+static const uint64_t *sort_key;
+
+static int by_inclusive(const void *x, const void *y){
+  uint64_t a = sort_key[*(const uint32_t *) x];
+  uint64_t b = sort_key[*(const uint32_t *) y];
+  if(a != b){
+    return a < b ? 1 : -1;
+  }
+  return *(const uint32_t *) x - *(const uint32_t *) y;
+}
+
+/*
+ * print the routines with the most inclusive cycles
+ */
+void callstack_report(CallStack *stack, FILE *out, int top){
+  uint32_t *idx = (uint32_t *) malloc((1 << 16) * sizeof(*idx));
+  for(uint32_t i = 0; i < (1 << 16); i++){
+    idx[i] = i;
+  }
+  sort_key = stack->inclusive;
+  qsort(idx, 1 << 16, sizeof(*idx), by_inclusive);
+
+  fprintf(out, "%-8s %10s %14s %7s %14s %7s\n", "routine", "calls", "inclusive", "%", "exclusive", "%");
+  for(int i = 0; i < (1 << 16) && (top <= 0 || i < top); i++){
+    uint32_t r = idx[i];
+    if(stack->calls[r] == 0){
+      break;
+    }
+    fprintf(out, "0x%04x   %10llu %14llu %6.2f%% %14llu %6.2f%%\n", r,
+            (unsigned long long) stack->calls[r],
+            (unsigned long long) stack->inclusive[r],
+            stack->now ? 100.0 * stack->inclusive[r] / stack->now : 0.0,
+            (unsigned long long) stack->exclusive[r],
+            stack->now ? 100.0 * stack->exclusive[r] / stack->now : 0.0);
+  }
+  if(stack->overflows){
+    fprintf(out, "calls deeper than %d frames: %llu\n", CALLSTACK_DEPTH,
+            (unsigned long long) stack->overflows);
+  }
+  free(idx);
+}
+
+/*
+ * write exclusive cycles per calling context in the folded stack format
+ * read by flamegraph.pl ("0x0000;0x18d9;0x1a32 1234")
+ */
+int callstack_write_folded(CallStack *stack, const char *path){
+  FILE *f = fopen(path, "w");
+  if(f == NULL){
+    return -1;
+  }
+  uint16_t chain[CALLSTACK_DEPTH + 1];
+  for(int32_t i = 0; i < stack->node_count; i++){
+    if(stack->nodes[i].exclusive == 0){
+      continue;
+    }
+    int n = 0;
+    for(int32_t j = i; j > 0 && n < CALLSTACK_DEPTH; j = stack->nodes[j].parent){
+      chain[n++] = stack->nodes[j].routine;
+    }
+    fprintf(f, "0x%04x", stack->nodes[0].routine);
+    while(n > 0){
+      fprintf(f, ";0x%04x", chain[--n]);
+    }
+    fprintf(f, " %llu\n", (unsigned long long) stack->nodes[i].exclusive);
+  }
+  return fclose(f);
+}
@@ -0,0 +1,64 @@
+#ifndef __CALLSTACK__
+#define __CALLSTACK__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "emulator.h"
+
+#define CALLSTACK_DEPTH 256
+
+/*
+ * one calling context: a routine reached through a particular chain of callers
+ */
+typedef struct CallNode {
+  uint16_t routine;
+  int32_t parent;
+  uint64_t calls;
+  uint64_t exclusive;
+} CallNode;
+
+/*
+ * an active call on the shadow stack
+ */
+typedef struct CallFrame {
+  int32_t node;
+  uint16_t routine;
+  uint16_t return_adr;
+  uint64_t entry;
+} CallFrame;
+
+typedef struct CallStack {
+  uint64_t now;
+  int depth;
+  uint64_t overflows;
+  CallFrame frames[CALLSTACK_DEPTH];
+
+  // calling context tree, node 0 is the reset entry point
+  CallNode *nodes;
+  int32_t node_count;
+  int32_t node_capacity;
+  int32_t *children;
+  uint32_t children_mask;
+
+  // totals per routine address, inclusive cycles skip recursive activations
+  uint64_t calls[1 << 16];
+  uint64_t inclusive[1 << 16];
+  uint64_t exclusive[1 << 16];
+  uint32_t active[1 << 16];
+} CallStack;
+
+CallStack *callstack_create(void);
+
+void callstack_free(CallStack *stack);
+
+void callstack_enter(CallStack *stack, uint16_t routine, uint16_t return_adr);
+
+void callstack_step(CallStack *stack, State8080 *state, uint8_t opcode, uint16_t pc, uint16_t sp, int cycles);
+
+void callstack_close(CallStack *stack);
+
+void callstack_report(CallStack *stack, FILE *out, int top);
+
+int callstack_write_folded(CallStack *stack, const char *path);
+
+#endif
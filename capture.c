@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "capture.h"
+
+#define WIDTH INVADERS_SCREEN_WIDTH
+#define HEIGHT INVADERS_SCREEN_HEIGHT
+
+/*
+ * write all of iov, which writev() to a pipe may do in pieces
+ */
+static int write_all(int fd, struct iovec *iov, int count){
+  while(count > 0){
+    ssize_t n = writev(fd, iov, count);
+    if(n < 0){
+      return -1;
+    }
+    while(count > 0 && (size_t) n >= iov->iov_len){
+      n -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if(count > 0){
+      iov->iov_base = (uint8_t *) iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+typedef struct StreamSink {
+  int fd;
+  int close_fd;
+  char header[64];
+  int header_len;
+} StreamSink;
+
+/*
+ * Y4M and PGM streams: a header per frame, then the pixels
+ */
+static int stream_write(void *ctx, const Picture *picture){
+  StreamSink *stream = (StreamSink *) ctx;
+  struct iovec iov[2] = {
+    {stream->header, stream->header_len},
+    {(void *) picture->pixels, sizeof(picture->pixels)},
+  };
+  return write_all(stream->fd, iov, 2);
+}
+
+static int stream_close(void *ctx){
+  StreamSink *stream = (StreamSink *) ctx;
+  int status = stream->close_fd && close(stream->fd) != 0 ? -1 : 0;
+  free(stream);
+  return status;
+}
+
+static uint32_t crc_table[256];
+
+static void crc_init(void){
+  for(uint32_t n = 0; n < 256; n++){
+    uint32_t c = n;
+    for(int k = 0; k < 8; k++){
+      c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    }
+    crc_table[n] = c;
+  }
+}
+
+// running CRC-32 of a PNG chunk, start from 0xffffffff and invert at the end
+static uint32_t crc_update(uint32_t crc, const uint8_t *bytes, size_t len){
+  for(size_t i = 0; i < len; i++){
+    crc = crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+static void put32(uint8_t *out, uint32_t v){
+  out[0] = v >> 24;
+  out[1] = v >> 16;
+  out[2] = v >> 8;
+  out[3] = v;
+}
+
+/*
+ * A PNG sequence. The image data is zlib with stored (uncompressed)
+ * deflate blocks, one per row holding its filter byte and the row, so
+ * the file is the row headers interleaved with the rows themselves and
+ * nothing is compressed or copied. Only the checksums read the pixels
+ */
+typedef struct PngSink {
+  char *pattern;
+  // signature, IHDR, and the start of IDAT up to the zlib header
+  uint8_t head[8 + 25 + 10];
+  // per row: the stored block header and the filter byte
+  uint8_t rows[HEIGHT][6];
+  // adler32, IDAT CRC, IEND
+  uint8_t tail[4 + 4 + 12];
+  struct iovec iov[2 + 2 * HEIGHT];
+} PngSink;
+
+static int png_write(void *ctx, const Picture *picture){
+  PngSink *png = (PngSink *) ctx;
+  char path[4096];
+  snprintf(path, sizeof(path), png->pattern, (int) picture->frame);
+
+  // CRC of IDAT from its type on, adler32 of what the deflate blocks hold
+  uint32_t crc = crc_update(0xffffffff, png->head + 37, 6);
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for(int y = 0; y < HEIGHT; y++){
+    const uint8_t *row = picture->pixels + y * WIDTH;
+    crc = crc_update(crc, png->rows[y], 6);
+    crc = crc_update(crc, row, WIDTH);
+    // the filter byte is 0, then the row
+    b = (b + a) % 65521;
+    for(int x = 0; x < WIDTH; x++){
+      a += row[x];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    png->iov[1 + 2 * y + 1].iov_base = (void *) row;
+  }
+  put32(png->tail, b << 16 | a);
+  crc = crc_update(crc, png->tail, 4);
+  put32(png->tail + 4, ~crc);
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0){
+    return -1;
+  }
+  struct iovec iov[2 + 2 * HEIGHT];
+  memcpy(iov, png->iov, sizeof(iov));
+  int status = write_all(fd, iov, 2 + 2 * HEIGHT);
+  if(close(fd) != 0){
+    status = -1;
+  }
+  return status;
+}
+
+static int png_close(void *ctx){
+  PngSink *png = (PngSink *) ctx;
+  free(png->pattern);
+  free(png);
+  return 0;
+}
+
+static PngSink *png_create(const char *pattern){
+  PngSink *png = (PngSink *) calloc(1, sizeof(PngSink));
+  png->pattern = strdup(pattern);
+  if(crc_table[1] == 0){
+    crc_init();
+  }
+
+  uint8_t *p = png->head;
+  memcpy(p, "\x89PNG\r\n\x1a\n", 8);
+  // 8 bit gray, no interlace
+  put32(p + 8, 13);
+  memcpy(p + 12, "IHDR", 4);
+  put32(p + 16, WIDTH);
+  put32(p + 20, HEIGHT);
+  memcpy(p + 24, "\x08\x00\x00\x00\x00", 5);
+  put32(p + 29, ~crc_update(0xffffffff, p + 12, 17));
+  uint32_t row_size = 1 + WIDTH;
+  put32(p + 33, 2 + HEIGHT * (5 + row_size) + 4);
+  memcpy(p + 37, "IDAT", 4);
+  // zlib header: deflate, 32 KiB window, no dictionary
+  p[41] = 0x78;
+  p[42] = 0x01;
+  for(int y = 0; y < HEIGHT; y++){
+    uint8_t *row = png->rows[y];
+    row[0] = y == HEIGHT - 1;
+    row[1] = row_size & 0xff;
+    row[2] = row_size >> 8;
+    row[3] = ~row_size & 0xff;
+    row[4] = (~row_size >> 8) & 0xff;
+    row[5] = 0;
+  }
+  memcpy(png->tail + 8, "\x00\x00\x00\x00IEND\xae\x42\x60\x82", 12);
+
+  png->iov[0] = (struct iovec) {png->head, sizeof(png->head)};
+  for(int y = 0; y < HEIGHT; y++){
+    png->iov[1 + 2 * y] = (struct iovec) {png->rows[y], 6};
+    png->iov[1 + 2 * y + 1] = (struct iovec) {NULL, WIDTH};
+  }
+  png->iov[1 + 2 * HEIGHT] = (struct iovec) {png->tail, sizeof(png->tail)};
+  return png;
+}
+
+/*
+ * 1 if pattern has exactly one integer conversion, %d with an optional
+ * width, and no other directive, so it is safe as a format for the frame
+ */
+static int frame_pattern(const char *pattern){
+  int conversions = 0;
+  for(const char *p = pattern; (p = strchr(p, '%')) != NULL; ){
+    p++;
+    while(*p >= '0' && *p <= '9'){
+      p++;
+    }
+    if(*p != 'd'){
+      return 0;
+    }
+    conversions++;
+  }
+  return conversions == 1;
+}
+
+static int has_suffix(const char *s, const char *suffix){
+  size_t n = strlen(s);
+  size_t m = strlen(suffix);
+  return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+int capture_open(const char *path, int every, FrameSink *sink){
+  if(strchr(path, '%')){
+    if(!frame_pattern(path)){
+      return -1;
+    }
+    sink->ctx = png_create(path);
+    sink->write = png_write;
+    sink->close = png_close;
+    sink->gaps = 1;
+    return 0;
+  }
+  StreamSink *stream = (StreamSink *) calloc(1, sizeof(StreamSink));
+  int y4m = strcmp(path, "-") == 0 || has_suffix(path, ".y4m");
+  if(strcmp(path, "-") == 0){
+    stream->fd = STDOUT_FILENO;
+  }
+  else {
+    stream->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    stream->close_fd = 1;
+  }
+  if(stream->fd < 0){
+    free(stream);
+    return -1;
+  }
+  if(y4m){
+    // the stream header goes out once, each frame only has FRAME
+    char header[128];
+    int len = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F60:%d Ip A1:1 Cmono\n", WIDTH, HEIGHT, every > 0 ? every : 1);
+    struct iovec iov = {header, len};
+    if(write_all(stream->fd, &iov, 1) != 0){
+      stream_close(stream);
+      return -1;
+    }
+    stream->header_len = snprintf(stream->header, sizeof(stream->header), "FRAME\n");
+  }
+  else {
+    stream->header_len = snprintf(stream->header, sizeof(stream->header), "P5\n%d %d\n255\n", WIDTH, HEIGHT);
+  }
+  sink->ctx = stream;
+  sink->write = stream_write;
+  sink->close = stream_close;
+  sink->gaps = 0;
+  return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef __CAPTURE__
+#define __CAPTURE__
+
+#include "pipeline.h"
+
+/*
+ * open a sink writing pictures to path, the format going by its name:
+ *
+ *   a printf pattern (shots/%05d.png)   one PNG per frame, numbered by frame
+ *   *.y4m, or - for stdout             a gray Y4M stream for video encoders
+ *   anything else                      binary PGM images back to back
+ *
+ * Pixels are written straight from the picture with writev(). every is
+ * the capture interval, which sets the frame rate of a Y4M stream. Only
+ * a PNG sequence can leave out duplicate frames. A pattern takes one %d,
+ * with a width if wanted, and no other % directive. Returns 0, or -1 if
+ * the pattern is not like that or the file could not be created
+ */
+int capture_open(const char *path, int every, FrameSink *sink);
+
+#endif
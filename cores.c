@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cores.h"
+#include "ref8080.h"
+
+typedef struct CoreEntry {
+  const char *name;
+  Core step;
+} CoreEntry;
+
+/*
+ * emulate_batch() held to one instruction, so it can be checked step by step
+ */
+static int batch_step(State8080 *state){
+  return emulate_batch(state, 1);
+}
+
+static const CoreEntry cores[] = {
+  {"emulate", emulate},
+  {"batch", batch_step},
+  {"ref", ref_step},
+};
+
+/*
+ * look a core up by name, exits listing the known cores if there is none
+ */
+Core find_core(const char *name){
+  for(size_t i = 0; i < sizeof(cores) / sizeof(*cores); i++){
+    if(strcmp(cores[i].name, name) == 0){
+      return cores[i].step;
+    }
+  }
+  fprintf(stderr, "unknown core %s, available:", name);
+  for(size_t i = 0; i < sizeof(cores) / sizeof(*cores); i++){
+    fprintf(stderr, " %s", cores[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+/*
+ * pack every register and flag, the EI delay and the OUT latch, equal
+ * states give equal signatures
+ */
+uint64_t state_signature(const State8080 *s){
+  uint64_t flags = s->cc.z | s->cc.s << 1 | s->cc.p << 2 | s->cc.cy << 3 | s->cc.ac << 4 | (s->int_enable & 1) << 5;
+  uint64_t sig = (uint64_t) s->a | (uint64_t) s->b << 8 | (uint64_t) s->c << 16 | (uint64_t) s->d << 24 |
+                 (uint64_t) s->e << 32 | (uint64_t) s->h << 40 | (uint64_t) s->l << 48 | flags << 56;
+  uint64_t latch = (uint64_t) s->out_port | (uint64_t) s->out_value << 8 | (uint64_t) (s->out_written & 1) << 16 | (uint64_t) (s->int_delay & 1) << 17;
+  sig ^= ((uint64_t) s->sp << 16 | s->pc) * 0x9e3779b97f4a7c15ull;
+  return sig ^ latch * 0xc2b2ae3d27d4eb4full;
+}
@@ -0,0 +1,17 @@
+#ifndef __CORES__
+#define __CORES__
+
+#include <stdint.h>
+#include "emulator.h"
+
+/*
+ * a core executes one instruction and returns its cycles, every core here
+ * can stand in for emulate() in the test harnesses
+ */
+typedef int (*Core)(State8080 *state);
+
+Core find_core(const char *name);
+
+uint64_t state_signature(const State8080 *state);
+
+#endif
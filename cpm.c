@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpm.h"
+
+/*
+ * reset the machine over a 64 KiB memory block, the zero page gets a warm
+ * boot at 0x0000 and a BDOS vector whose target is never executed
+ */
+void cpm_init(CpmMachine *machine, uint8_t *memory, void (*console)(void *ctx, char c), void *ctx){
+  memset(machine, 0, sizeof(*machine));
+  memset(memory, 0, MEMORY_ALLOC);
+  machine->state.memory = memory;
+  machine->state.pc = CPM_TPA;
+  machine->core = emulate;
+  machine->console = console;
+  machine->ctx = ctx;
+
+  // JMP 0x0000 for warm boot, JMP BDOS with the top of the TPA at 0x0006
+  memory[0x0000] = 0xc3;
+  memory[CPM_BDOS] = 0xc3;
+  memory[CPM_BDOS + 1] = CPM_BDOS_TOP & 0xff;
+  memory[CPM_BDOS + 2] = CPM_BDOS_TOP >> 8;
+  memory[CPM_BDOS_TOP] = 0xc9;
+  memory_sync_guard(memory);
+}
+
+/*
+ * copy a .COM image to the TPA, returns -1 if it does not fit
+ */
+int cpm_load_image(CpmMachine *machine, const uint8_t *image, size_t size){
+  if(size > CPM_BDOS_TOP - CPM_TPA){
+    return -1;
+  }
+  memcpy(machine->state.memory + CPM_TPA, image, size);
+  return 0;
+}
+
+/*
+ * read a .COM file into the TPA, returns -1 on failure
+ */
+int cpm_load(CpmMachine *machine, const char *path){
+  FILE *f = fopen(path, "rb");
+  if(f == NULL){
+    return -1;
+  }
+  uint8_t *image = (uint8_t *) malloc(CPM_BDOS_TOP);
+  size_t size = fread(image, 1, CPM_BDOS_TOP, f);
+  fclose(f);
+  int res = cpm_load_image(machine, image, size);
+  free(image);
+  return res;
+}
+
+static void put(CpmMachine *machine, char c){
+  if(machine->console){
+    machine->console(machine->ctx, c);
+  }
+}
+
+/*
+ * handle the BDOS call in register C and return to the caller
+ */
+static void bdos(CpmMachine *machine){
+  State8080 *state = &machine->state;
+  switch(state->c){
+    case 0:
+      machine->done = 1;
+      break;
+
+    case 2:
+      put(machine, state->e);
+      break;
+
+    case 9:;
+      // a string with no $ stops after going once around memory
+      uint16_t adr = state->de;
+      for(uint32_t n = 0; n < MEMORY_SIZE && state->memory[adr] != '$'; n++){
+        put(machine, state->memory[adr++]);
+      }
+      break;
+  }
+  ret(state);
+}
+
+/*
+ * run until the program warm boots or max_instructions have run (0 for no
+ * limit), returns 1 once the program has finished
+ */
+int cpm_run(CpmMachine *machine, uint64_t max_instructions){
+  State8080 *state = &machine->state;
+  uint64_t end = machine->instructions + max_instructions;
+  while(!machine->done && (max_instructions == 0 || machine->instructions < end)){
+    if(state->pc == CPM_BDOS){
+      bdos(machine);
+      continue;
+    }
+    if(state->pc == 0x0000){
+      machine->done = 1;
+      break;
+    }
+    machine->cycles += machine->core(state);
+    machine->instructions++;
+  }
+  return machine->done;
+}
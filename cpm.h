@@ -0,0 +1,38 @@
+#ifndef __CPM__
+#define __CPM__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "emulator.h"
+
+// .COM programs are loaded and started at the bottom of the TPA
+#define CPM_TPA 0x0100
+// BDOS entry point called by programs, and where its vector points
+#define CPM_BDOS 0x0005
+#define CPM_BDOS_TOP 0xf000
+
+/*
+ * a headless CP/M-lite machine: 64 KiB of memory, warm boot at 0x0000
+ * stops the program and BDOS calls are trapped at 0x0005
+ */
+typedef struct CpmMachine {
+  State8080 state;
+  uint64_t instructions;
+  uint64_t cycles;
+  int done;
+  // the core that executes instructions, emulate() unless replaced
+  int (*core)(State8080 *state);
+  // receives every character the program prints
+  void (*console)(void *ctx, char c);
+  void *ctx;
+} CpmMachine;
+
+void cpm_init(CpmMachine *machine, uint8_t *memory, void (*console)(void *ctx, char c), void *ctx);
+
+int cpm_load_image(CpmMachine *machine, const uint8_t *image, size_t size);
+
+int cpm_load(CpmMachine *machine, const char *path);
+
+int cpm_run(CpmMachine *machine, uint64_t max_instructions);
+
+#endif
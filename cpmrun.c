@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpm.h"
+
+static void console(void *ctx, char c){
+  putchar(c);
+  if(c == '\n'){
+    fflush(stdout);
+  }
+}
+
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-n max_instructions] [-q] program.com\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv){
+  uint64_t max_instructions = 0;
+  int quiet = 0;
+  int opt;
+  while((opt = getopt(argc, argv, "n:q")) != -1){
+    switch(opt){
+      case 'n':
+        max_instructions = atoll(optarg);
+        break;
+      case 'q':
+        quiet = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if(optind != argc - 1){
+    usage(argv[0]);
+  }
+
+  CpmMachine machine;
+  uint8_t *memory = (uint8_t *) malloc(MEMORY_ALLOC);
+  cpm_init(&machine, memory, quiet ? NULL : console, NULL);
+  if(cpm_load(&machine, argv[optind]) != 0){
+    fprintf(stderr, "could not load %s\n", argv[optind]);
+    return 1;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int finished = cpm_run(&machine, max_instructions);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fflush(stdout);
+
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+  fprintf(stderr, "\n%s after %llu instructions, %llu cycles in %.3f s (%.1f emulated MHz)\n",
+          finished ? "finished" : "stopped",
+          (unsigned long long) machine.instructions,
+          (unsigned long long) machine.cycles, seconds,
+          seconds > 0 ? machine.cycles / seconds / 1e6 : 0.0);
+  free(memory);
+  return finished ? 0 : 2;
+}
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "emulator.h"
+#include "cores.h"
+#include "opcodes.h"
+#include "cpm.h"
+#include "rom.h"
+#include "hash.h"
+#include "interrupt.h"
+#include "machine.h"
+
+/*
+ * Lockstep differential testing: two cores run the same program on their
+ * own copy of the machine. Registers and cycle counts are compared after
+ * every instruction, memory by hash at the end of every block. A memory
+ * mismatch is bisected back to the first instruction that caused it by
+ * replaying the block from a checkpoint. The invaders ROM (-i) runs with
+ * the board's video interrupts but nothing on the input ports, so it
+ * covers the attract mode, not a game being played.
+ */
+
+/*
+ * the video interrupts of the invaders board in -i mode, RST 1 halfway
+ * down the frame and RST 2 at its end as machine.c schedules them, timed
+ * by the side's own cycle count
+ */
+typedef struct Video {
+  Interrupts irq;
+  uint64_t next;
+  uint8_t half;
+} Video;
+
+typedef struct Side {
+  const char *name;
+  CpmMachine machine;
+  uint8_t *memory;
+  // checkpoint at the start of the current block
+  CpmMachine saved;
+  uint8_t *saved_memory;
+  Video video;
+  Video saved_video;
+} Side;
+
+static int cpm_mode;
+
+static void step(Side *side){
+  if(cpm_mode){
+    cpm_run(&side->machine, 1);
+  }
+  else {
+    State8080 *state = &side->machine.state;
+    Video *video = &side->video;
+    side->machine.cycles += side->machine.core(state);
+    side->machine.instructions++;
+    if(side->machine.cycles >= video->next){
+      interrupt_request(&video->irq, video->half ? 2 : 1);
+      video->half = !video->half;
+      video->next += INVADERS_FRAME_CYCLES / 2;
+    }
+    // the instruction after an EI is the core's next step, not emulate()'s
+    if(!state->int_delay){
+      side->machine.cycles += interrupt_service(&video->irq, state);
+    }
+  }
+}
+
+static void save(Side *side){
+  side->saved = side->machine;
+  side->saved_video = side->video;
+  memcpy(side->saved_memory, side->memory, MEMORY_ALLOC);
+}
+
+static void restore(Side *side){
+  side->machine = side->saved;
+  side->machine.state.memory = side->memory;
+  side->video = side->saved_video;
+  memcpy(side->memory, side->saved_memory, MEMORY_ALLOC);
+}
+
+static void print_state(const char *name, const State8080 *s){
+  printf("  %-8s pc=%04x sp=%04x a=%02x b=%02x c=%02x d=%02x e=%02x h=%02x l=%02x z=%d s=%d p=%d cy=%d ac=%d ie=%d delay=%d out=%d:%02x=%02x\n",
+         name, s->pc, s->sp, s->a, s->b, s->c, s->d, s->e, s->h, s->l,
+         s->cc.z, s->cc.s, s->cc.p, s->cc.cy, s->cc.ac, s->int_enable,
+         s->int_delay, s->out_written, s->out_port, s->out_value);
+}
+
+/*
+ * print the instruction that made the two sides diverge, before is the
+ * common state it started from
+ */
+static void report(Side *a, Side *b, const State8080 *before, uint64_t before_cycles, uint64_t index){
+  uint8_t opcode = before->memory[before->pc];
+  printf("divergence at instruction %llu, pc 0x%04x: %s",
+         (unsigned long long) index, before->pc, opcode_names[opcode]);
+  for(int i = 1; i < opcode_lengths[opcode]; i++){
+    printf(" %02x", before->memory[(uint16_t) (before->pc + i)]);
+  }
+  printf("\n");
+  print_state("before", before);
+  print_state(a->name, &a->machine.state);
+  print_state(b->name, &b->machine.state);
+  if(a->machine.cycles != b->machine.cycles){
+    printf("  cycles   %s=%llu %s=%llu\n", a->name, (unsigned long long) (a->machine.cycles - before_cycles),
+           b->name, (unsigned long long) (b->machine.cycles - before_cycles));
+  }
+  int shown = 0;
+  for(int adr = 0; adr < (1 << 16) && shown < 8; adr++){
+    if(a->memory[adr] != b->memory[adr]){
+      printf("  memory %04x: %s=%02x %s=%02x\n", adr, a->name, a->memory[adr], b->name, b->memory[adr]);
+      shown++;
+    }
+  }
+}
+
+/*
+ * replay steps instructions from the checkpoint on both sides
+ */
+static void replay(Side *a, Side *b, uint64_t steps){
+  restore(a);
+  restore(b);
+  for(uint64_t i = 0; i < steps; i++){
+    step(a);
+    step(b);
+  }
+}
+
+/*
+ * replay the block up to its index-th instruction and report that one
+ */
+static void pinpoint(Side *a, Side *b, uint64_t base, uint64_t index){
+  replay(a, b, index);
+  State8080 before = a->machine.state;
+  uint8_t *before_memory = (uint8_t *) malloc(MEMORY_ALLOC);
+  memcpy(before_memory, a->memory, MEMORY_ALLOC);
+  before.memory = before_memory;
+  uint64_t before_cycles = a->machine.cycles;
+  step(a);
+  step(b);
+  report(a, b, &before, before_cycles, base + index);
+  free(before_memory);
+}
+
+/*
+ * memory differs after steps instructions of the block: bisect for the
+ * first instruction after which it differs
+ */
+static void bisect(Side *a, Side *b, uint64_t base, uint64_t steps){
+  uint64_t lo = 0;
+  uint64_t hi = steps;
+  while(hi - lo > 1){
+    uint64_t mid = lo + (hi - lo) / 2;
+    replay(a, b, mid);
+    if(memcmp(a->memory, b->memory, 1 << 16) == 0){
+      lo = mid;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  pinpoint(a, b, base, hi - 1);
+}
+
+static void setup(Side *side, const char *name, Core core, const char *program){
+  side->name = name;
+  side->memory = (uint8_t *) malloc(MEMORY_ALLOC);
+  side->saved_memory = (uint8_t *) malloc(MEMORY_ALLOC);
+  cpm_init(&side->machine, side->memory, NULL, NULL);
+  side->machine.core = core;
+  if(cpm_mode){
+    if(cpm_load(&side->machine, program) != 0){
+      fprintf(stderr, "could not load %s\n", program);
+      exit(1);
+    }
+  }
+  else {
+    memset(side->memory, 0, MEMORY_ALLOC);
+    load_invaders(side->memory, (char *) program);
+    side->machine.state.pc = 0;
+  }
+  interrupt_init(&side->video.irq);
+  side->video.next = INVADERS_FRAME_CYCLES / 2;
+  side->video.half = 0;
+}
+
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-a core] [-b core] [-n instructions] [-B block] (-c program.com | -i rom_folder)\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv){
+  const char *core_a = "emulate";
+  const char *core_b = "ref";
+  const char *program = NULL;
+  uint64_t max_instructions = 100000000;
+  uint64_t block = 4096;
+  int opt;
+  while((opt = getopt(argc, argv, "a:b:n:B:c:i:")) != -1){
+    switch(opt){
+      case 'a':
+        core_a = optarg;
+        break;
+      case 'b':
+        core_b = optarg;
+        break;
+      case 'n':
+        max_instructions = atoll(optarg);
+        break;
+      case 'B':
+        block = atoll(optarg);
+        break;
+      case 'c':
+        cpm_mode = 1;
+        program = optarg;
+        break;
+      case 'i':
+        cpm_mode = 0;
+        program = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if(program == NULL || block == 0){
+    usage(argv[0]);
+  }
+
+  Side a, b;
+  setup(&a, core_a, find_core(core_a), program);
+  setup(&b, core_b, find_core(core_b), program);
+
+  uint64_t done = 0;
+  while(done < max_instructions && !(a.machine.done && b.machine.done)){
+    save(&a);
+    save(&b);
+    uint64_t steps = 0;
+    while(steps < block && done + steps < max_instructions && !(a.machine.done && b.machine.done)){
+      step(&a);
+      step(&b);
+      steps++;
+      if(state_signature(&a.machine.state) != state_signature(&b.machine.state) || a.machine.cycles != b.machine.cycles){
+        pinpoint(&a, &b, done, steps - 1);
+        return 1;
+      }
+    }
+    if(hash_ram(a.memory) != hash_ram(b.memory)){
+      bisect(&a, &b, done, steps);
+      return 1;
+    }
+    done += steps;
+  }
+
+  printf("%s and %s agree on %llu instructions%s\n", core_a, core_b,
+         (unsigned long long) done, a.machine.done ? " (program finished)" : "");
+  return 0;
+}
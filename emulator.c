@@ -1,6 +1,8 @@
 #include <stdio.h> 
 #include <stdlib.h> 
+#include <string.h>
 #include "emulator.h"
+#include "opcodes.h"
 
 /*
  * combine uint8_t into uint16_t 
@@ -11,14 +13,21 @@ uint16_t make_word(uint8_t left, uint8_t right) {
   return res; 
 }
 
+/*
+ * copy the bottom of memory to the guard after it was written directly
+ */
+void memory_sync_guard(uint8_t *memory){
+  memcpy(memory + MEMORY_SIZE, memory, MEMORY_GUARD);
+}
+
 /* 
- * Get the next word and increment the program counter
+ * Get the word operand at the program counter and step past it
  */
 uint16_t next_word(State8080 *state){
   uint8_t left; 
   uint8_t right; 
-  right = state->memory[state->pc+1]; 
-  left = state->memory[state->pc+2]; 
+  right = MEM_READ(state, state->pc); 
+  left = MEM_READ(state, state->pc + 1); 
   state->pc += 2; 
   return make_word(left, right); 
 }
@@ -44,39 +53,42 @@ int carry(int bit, uint8_t a, uint8_t b) {
 }
 
 /* 
- * returns the next byte, updates pc 
+ * returns the byte operand at the program counter, updates pc 
  */
 uint8_t next_byte(State8080 *state) {
-  state->pc++; 
-  return state->memory[state->pc]; 
+  return MEM_READ(state, state->pc++); 
 }
 
 /* 
- * purpose: set flags after arithmetic group
+ * purpose: set the zero, sign and parity flags after arithmetic group,
+ * each instruction sets carry and auxiliary carry itself
  */
 void flags_arithmetic(State8080 *state, uint16_t answer){
   state->cc.z = ((answer & 0xff) == 0);
   state->cc.s = ((answer & 0x80) != 0);
   state->cc.p = parity(answer & 0xff);
-  state->cc.ac = carry(4, state->b, 1);
 }
 
 /* 
- * implement the STAX opcodes by taking necessary registers 
+ * auxiliary carry of a + b + carry_in out of the low nibble, subtractions
+ * pass the complement of the subtrahend and the inverted borrow
  */
-void stax(State8080 *state, uint8_t a, uint8_t b, uint8_t c){
-  uint16_t register_pair = make_word(a, b); 
-  state->memory[register_pair] = c; 
+int aux_carry(uint8_t a, uint8_t b, int carry_in){
+  return ((a & 0x0f) + (b & 0x0f) + carry_in) > 0x0f; 
 }
 
 /* 
- * implement the INX opcodes by taking necessary registers
+ * implement the STAX opcodes by storing A at the address in a register pair
  */
-void inx(uint8_t *a, uint8_t *b){
-  uint16_t register_pair = make_word(*a, *b); 
-  register_pair++; 
-  *a = register_pair >> 8; 
-  *b = register_pair & 0xff; 
+void stax(State8080 *state, uint16_t adr){
+  MEM_WRITE(state, adr, state->a); 
+}
+
+/* 
+ * implement the INX opcodes on a register pair
+ */
+void inx(uint16_t *pair){
+  (*pair)++; 
 }
 
 /* 
@@ -85,6 +97,7 @@ void inx(uint8_t *a, uint8_t *b){
 void inr(State8080 *state, uint8_t *a){
   uint16_t answer = *a + 1;
   flags_arithmetic(state, answer);
+  state->cc.ac = (answer & 0x0f) == 0; 
   *a = (answer & 0xff);
 }
  
@@ -94,16 +107,15 @@ void inr(State8080 *state, uint8_t *a){
 void dcr(State8080 *state, uint8_t *a){
   uint16_t answer = *a - 1;
   flags_arithmetic(state, answer);
+  state->cc.ac = (answer & 0x0f) != 0x0f; 
   *a = (answer & 0xff);
 }
 
 /* 
- * implement the LXI opcodes by taking state and the necessary register
+ * implement the LXI opcodes by taking state and the register pair
  */
-void lxi(State8080 *state, uint8_t *a, uint8_t *b){
-  *a = state->memory[state->pc + 2];
-  *b = state->memory[state->pc + 1]; 
-  state->pc += 2;
+void lxi(State8080 *state, uint16_t *pair){
+  *pair = next_word(state); 
 }
 
 /* 
@@ -122,38 +134,34 @@ void rlc(State8080 *state){
 }
 
 /* 
- * implement the DAD opcode by taking state and the necessary registers
+ * implement the DAD opcode by adding a register pair to HL
  */
-void dad(State8080 *state, uint8_t *a, uint8_t *b, uint8_t *c, uint8_t *d){
-  uint16_t register_pair = make_word(*a, *b) + make_word(*c, *d);
-  state->cc.cy = ((register_pair >> 16) & 1);  
-  *a = register_pair >> 8;
-  *b = register_pair & 0xff;
+void dad(State8080 *state, uint16_t pair){
+  uint32_t sum = state->hl + pair;
+  state->cc.cy = ((sum >> 16) & 1);  
+  state->hl = sum & 0xffff;
 }
 
 /* 
- * implement the LDAX opcode by taking the necessary registers
+ * implement the LDAX opcode by loading A from the address in a register pair
  */
-void ldax(State8080 *state, uint8_t *a, uint8_t *b, uint8_t *c){
-  *a = state->memory[make_word(*b, *c)]; 
+void ldax(State8080 *state, uint16_t adr){
+  state->a = MEM_READ(state, adr); 
 }
 
 /* 
- * implement the dcx opcode by taking the necessary registers
+ * implement the dcx opcode on a register pair
  */
-void dcx(uint8_t *a, uint8_t *b){
-  uint16_t register_pair = make_word(*a, *b); 
-  register_pair--; 
-  *a = register_pair >> 8; 
-  *b = register_pair & 0xff;   
+void dcx(uint16_t *pair){
+  (*pair)--; 
 }
 
 /* 
  * implement the RRC opcode
  */
 void rrc(State8080 *state){
-  state->cc.cy = state->a << 7;
-  state->a = (state->a << 1) | (state->cc.cy << 7);
+  state->cc.cy = state->a & 1;
+  state->a = (state->a >> 1) | (state->cc.cy << 7);
 }
 
 /* 
@@ -180,40 +188,37 @@ void rar(State8080 *state){
  * Implement shld opcode
  */
 void shld(State8080 *state){
-  uint16_t address = make_word(state->memory[state->pc + 1], state->memory[state->pc + 2]); 
-  state->memory[address] = state->l; 
-  state->memory[address + 1] = state->h; 
-  state->pc += 2; 
+  uint16_t address = next_word(state); 
+  MEM_WRITE(state, address, state->l); 
+  MEM_WRITE(state, (uint16_t) (address + 1), state->h); 
 }
 
 /* 
  * Implement daa opcode
  */
 void daa(State8080 *state){
-  uint16_t res; 
-  uint8_t smallest_four = state->a & 0xff; 
+  uint8_t correction = 0; 
+  uint8_t cy = state->cc.cy; 
+  uint8_t smallest_four = state->a & 0x0f; 
+  uint8_t most_four = state->a >> 4;
   if(smallest_four > 9 || state->cc.ac){
-    res = state->a + 6;
-    flags_arithmetic(state, res); 
-    state->a = res & 0xff;
+    correction |= 0x06; 
   }
-  uint8_t most_four = state->a >> 4;
-  if(most_four > 9 || state->cc.cy){
-    most_four += 6; 
+  if(most_four > 9 || state->cc.cy || (most_four >= 9 && smallest_four > 9)){
+    correction |= 0x60; 
+    cy = 1; 
   } 
-  res = (most_four << 4) | smallest_four; 
-  flags_arithmetic(state, res); 
-  state->a = res & 0xff;
+  add(state, correction); 
+  state->cc.cy = cy; 
 }
 
 /* 
  * Implement the lhld opcode
  */
 void lhld(State8080 *state){
-  uint16_t address = make_word(state->memory[state->pc + 1], state->memory[state->pc + 2]);
-  state->memory[address] = state->l; 
-  state->memory[address + 1] = state->h; 
-  state->pc += 2; 
+  uint16_t address = next_word(state);
+  state->l = MEM_READ(state, address); 
+  state->h = MEM_READ(state, address + 1); 
 }
 
 /* 
@@ -227,19 +232,15 @@ void cma(uint8_t *a){
  * Implement lxi for the stack pointer
  */
 void lxi_sp(State8080 *state){
-  uint8_t byte2 = state->memory[state->pc + 1]; 
-  uint8_t byte3 = state->memory[state->pc + 2]; 
-  state->sp = make_word(byte2, byte3); 
-  state->pc += 2; 
+  state->sp = next_word(state); 
 }
 
 /* 
  * Implement sta opcode 
  */
 void sta(State8080 *state, uint8_t *a){
-  uint16_t address = make_word(state->memory[state->pc + 1], state->memory[state->pc + 2]);
-  state->memory[address] = state->a; 
-  state->pc += 2;
+  uint16_t address = next_word(state);
+  MEM_WRITE(state, address, state->a); 
 }
 
 /* 
@@ -252,33 +253,31 @@ void inx_sp(State8080 *state){
 /* 
  * Implement inr for memory 
  */
-void inr_memory(State8080 *state, uint8_t *a, uint8_t *b){
-  uint16_t address = make_word(*a, *b); 
+void inr_memory(State8080 *state, uint16_t adr){
   uint16_t answer; 
-  answer = state->memory[address] + 1; 
-  state->memory[address] = answer & 0xff; 
+  answer = MEM_READ(state, adr) + 1; 
+  MEM_WRITE(state, adr, answer & 0xff); 
   flags_arithmetic(state, answer); 
+  state->cc.ac = (answer & 0x0f) == 0; 
    
 }
 
 /* 
  * Implement dcr for memory
  */
-void dcr_memory(State8080 *state, uint8_t *a, uint8_t *b){
-  uint16_t address = make_word(*a, *b); 
+void dcr_memory(State8080 *state, uint16_t adr){
   uint16_t answer; 
-  answer = state->memory[address] - 1; 
-  state->memory[address] = answer & 0xff; 
+  answer = MEM_READ(state, adr) - 1; 
+  MEM_WRITE(state, adr, answer & 0xff); 
   flags_arithmetic(state, answer); 
+  state->cc.ac = (answer & 0x0f) != 0x0f; 
 }
 
 /* 
  * Implement MVI opcode for memory
  */
-void mvi_memory(State8080 *state, uint8_t *a, uint8_t *b){
-  uint16_t address = make_word(*a, *b); 
-  state->memory[address] = state->memory[state->pc + 1]; 
-  state->pc++;  
+void mvi_memory(State8080 *state, uint16_t adr){
+  MEM_WRITE(state, adr, next_byte(state)); 
 }
 
 /* 
@@ -292,9 +291,8 @@ void stc(State8080 *state){
  * Implement the lda opcode
  */
 void lda(State8080 *state){
-  uint16_t address = make_word(state->memory[state->pc + 1], state->memory[state->pc + 2]);
-  state->a = state->memory[address]; 
-  state->pc += 2; 
+  uint16_t address = next_word(state);
+  state->a = MEM_READ(state, address); 
 }
 
 /* 
@@ -314,26 +312,28 @@ void cmc(State8080 *state){
 /* 
  * Implement the add opcodes
  */
-void add(State8080 *state, uint8_t *a, uint8_t *b){
-  uint16_t a16 = (uint16_t) *a; 
-  uint16_t b16 = (uint16_t) *b;
-  uint16_t answer = a16 + b16; 
+void add(State8080 *state, uint8_t x){
+  uint16_t a16 = (uint16_t) state->a; 
+  uint16_t x16 = (uint16_t) x;
+  uint16_t answer = a16 + x16; 
   flags_arithmetic(state, answer); 
   state->cc.cy = answer > 0xff; 
+  state->cc.ac = aux_carry(state->a, x, 0); 
   state->a = answer & 0xff; 
 }
 
 /*
  * Implement the ADC opcodes
  */
-void adc(State8080 *state, uint8_t *a, uint8_t *b){
+void adc(State8080 *state, uint8_t x){
   // turn all into uint_16 so they can be added 
   uint16_t carry = (uint16_t) state->cc.cy; 
-  uint16_t a16 = (uint16_t) *a; 
-  uint16_t b16 = (int16_t) *b; 
-  uint16_t answer = a16 + b16 + carry; 
+  uint16_t a16 = (uint16_t) state->a; 
+  uint16_t x16 = (uint16_t) x; 
+  uint16_t answer = a16 + x16 + carry; 
   flags_arithmetic(state, answer); 
   state->cc.cy = answer > 0xff; 
+  state->cc.ac = aux_carry(state->a, x, carry); 
   state->a = answer & 0xff; 
 }
 
@@ -346,6 +346,7 @@ void sub(State8080 *state, uint8_t x){
   uint16_t answer = a16 - x16; 
   flags_arithmetic(state, answer); 
   state->cc.cy = answer > 0xff; 
+  state->cc.ac = aux_carry(state->a, ~x, 1); 
   state->a = answer & 0xff; 
 }
 
@@ -359,6 +360,7 @@ void sbb(State8080 *state, uint8_t x){
   uint16_t answer = a16 - x16 - carry; 
   flags_arithmetic(state, answer); 
   state->cc.cy = answer > 0xff; 
+  state->cc.ac = aux_carry(state->a, ~x, !carry); 
   state->a = answer & 0xff; 
 }
 
@@ -370,7 +372,8 @@ void ana(State8080 *state, uint8_t x){
   uint16_t a16 = (uint16_t) state->a; 
   uint16_t answer = a16 & x16; 
   flags_arithmetic(state, answer); 
-  state->cc.cy = answer > 0xff; 
+  state->cc.cy = 0; 
+  state->cc.ac = ((a16 | x16) & 0x08) != 0; 
   state->a = answer & 0xff; 
 }
 
@@ -382,7 +385,8 @@ void xra(State8080 *state, uint8_t x){
   uint16_t x16 = (uint16_t) x; 
   uint16_t answer = a16 ^ x16; 
   flags_arithmetic(state, answer); 
-  state->cc.cy = answer > 0xff; 
+  state->cc.cy = 0; 
+  state->cc.ac = 0; 
   state->a = answer & 0xff; 
 }
 
@@ -394,7 +398,8 @@ void ora(State8080 *state, uint8_t x){
   uint16_t x16 = (uint16_t) x; 
   uint16_t answer = a16 | x16; 
   flags_arithmetic(state, answer); 
-  state->cc.cy = answer > 0xff; 
+  state->cc.cy = 0; 
+  state->cc.ac = 0; 
   state->a = answer & 0xff; 
 }
 
@@ -407,6 +412,7 @@ void cmp(State8080 *state, uint8_t x){
   uint16_t answer = a16 - x16; 
   flags_arithmetic(state, answer); 
   state->cc.cy = answer > 0xff; 
+  state->cc.ac = aux_carry(state->a, ~x, 1); 
 }
 
 /* 
@@ -415,27 +421,29 @@ void cmp(State8080 *state, uint8_t x){
 void ret(State8080 *state){
   uint8_t byte1; 
   uint8_t byte2; 
-  byte1 = state->memory[state->sp]; 
-  byte2 = state->memory[state->sp + 1]; 
-  state->pc = make_word(byte1, byte2); 
+  byte1 = MEM_READ(state, state->sp); 
+  byte2 = MEM_READ(state, state->sp + 1); 
+  state->pc = make_word(byte2, byte1); 
   state->sp = state->sp + 2; 
 }
 
 /* 
- * Implement conditional return opcodes
+ * Implement conditional return opcodes, returns 1 if the return was taken
  */
-void ret_cond(State8080 *state, uint8_t cond){
+int ret_cond(State8080 *state, uint8_t cond){
   if(cond){
     ret(state); 
   }
+  return cond != 0; 
 }
 
 /* 
  * Implement pop opcodes
  */
-void pop_pair(State8080 *state, uint8_t *hi, uint8_t *lo){
-  *lo = state->memory[state->sp]; 
-  *hi = state->memory[state->sp+1]; 
+void pop_pair(State8080 *state, uint16_t *pair){
+  uint8_t lo = MEM_READ(state, state->sp); 
+  uint8_t hi = MEM_READ(state, state->sp + 1); 
+  *pair = make_word(hi, lo); 
   state->sp = state->sp + 2; 
 }
 
@@ -463,12 +471,13 @@ void push_word(State8080 *state, uint16_t word){
   uint8_t hi = (word >> 8) & 0xff; 
   uint8_t lo = word & 0xff; 
   state->sp = state->sp - 2; 
-  state->memory[state->sp] = lo; 
-  state->memory[state->sp+1] = hi; 
+  MEM_WRITE(state, state->sp, lo); 
+  MEM_WRITE(state, (uint16_t) (state->sp + 1), hi); 
 }
 
 /* 
- * Call and address by pushing the program counter onto the stack, and then jumping to it
+ * Call and address by pushing the program counter (the address of the next
+ * instruction) onto the stack, and then jumping to it
  */
 void call_adr(State8080 *state, uint16_t adr){
   push_word(state, state->pc); 
@@ -476,45 +485,83 @@ void call_adr(State8080 *state, uint16_t adr){
 }
 
 /* 
- * Implement call condition opcodes
+ * Implement call condition opcodes, returns 1 if the call was taken
  */
-void call_cond(State8080 *state, uint8_t cond){
+int call_cond(State8080 *state, uint8_t cond){
   uint16_t adr = next_word(state); 
   if(cond){
     call_adr(state, adr); 
   }
+  return cond != 0; 
 }
 
 /* 
- * Swap two pointers
+ * Swap two register pairs
  */
-void swap_ptr(uint8_t *a, uint8_t *b){
-  uint8_t *temp = a; 
-  a = b; 
-  b = temp; 
+void swap_pair(uint16_t *a, uint16_t *b){
+  uint16_t temp = *a; 
+  *a = *b; 
+  *b = temp; 
 }
 
+/*
+ * register operands of the MOV and ALU blocks by field name
+ */
+#define GET_b state->b
+#define GET_c state->c
+#define GET_d state->d
+#define GET_e state->e
+#define GET_h state->h
+#define GET_l state->l
+#define GET_m MEM_READ(state, state->hl)
+#define GET_a state->a
+#define SET_b(val) state->b = (val)
+#define SET_c(val) state->c = (val)
+#define SET_d(val) state->d = (val)
+#define SET_e(val) state->e = (val)
+#define SET_h(val) state->h = (val)
+#define SET_l(val) state->l = (val)
+#define SET_m(val) MEM_WRITE(state, state->hl, val)
+#define SET_a(val) state->a = (val)
+
+#define MOV_CASE(d, s, dst, src) \
+    case 0x40 | (d) << 3 | (s): \
+	if((d) != 6 || (s) != 6) SET_##dst(GET_##src); \
+	break;
+#define MOV_ROW(d, dst) SOURCES(MOV_CASE, d, dst)
+
+#define ALU_CASE(o, s, op, src) \
+    case 0x80 | (o) << 3 | (s): \
+	op(state, GET_##src); \
+	break;
+#define ALU_ROW(o, op, OP) SOURCES(ALU_CASE, o, op)
+
 /* 
  * purpose: obtain the current opcode, emulate accordingly 
  * input: State8080 state
+ * output: number of clock cycles the instruction took
  */
 int emulate(State8080 *state) {
-  unsigned char *opcode = &state->memory[state->pc]; 
+  unsigned char opcode = MEM_FETCH(state, state->pc); 
+  int cycles = opcode_cycles[opcode]; 
+  // operands are fetched from the byte after the opcode onwards
+  state->pc += 1; 
+  state->int_delay = 0; 
 
-  switch(*opcode) {
+  switch(opcode) {
     case 0x00:
         break; 
     
     case 0x01:
-	lxi(state, &state->b, &state->c); 
+	lxi(state, &state->bc); 
 	break;
     
     case 0x02: 
-	stax(state, state->b, state->c, state->a); 
+	stax(state, state->bc); 
         break; 
     
     case 0x03: 
-	inx(&state->b, &state->c);  
+	inx(&state->bc);  
         break;
    
     case 0x04:
@@ -537,15 +584,15 @@ int emulate(State8080 *state) {
 	break; 
 
     case 0x09: 
-	dad(state, &state->h, &state->l, &state->b, &state->c); 
+	dad(state, state->bc); 
         break; 	
 
     case 0x0a:
-	ldax(state, &state->a, &state->b, &state->c); 	
+	ldax(state, state->bc); 	
 	break;
 
     case 0x0b: 
-	dcx(&state->b, &state->c);  
+	dcx(&state->bc);  
         break;
     
     case 0x0c: 
@@ -568,15 +615,15 @@ int emulate(State8080 *state) {
 	break; 
 
     case 0x11: 
-	lxi(state, &state->d, &state->e); 
+	lxi(state, &state->de); 
         break;	
 
     case 0x12:
-        stax(state, state->d, state->e, state->a); 	
+        stax(state, state->de); 	
 	break;
    
     case 0x13: 
-        inx(&state->d, &state->e);
+        inx(&state->de);
 	break; 
 
     case 0x14:
@@ -599,15 +646,15 @@ int emulate(State8080 *state) {
 	break; 
 
     case 0x19: 
-	dad(state, &state->h, &state->l, &state->d, &state->e); 
+	dad(state, state->de); 
 	break; 
 
     case 0x1a:
-        ldax(state, &state->a, &state->d, &state->e); 
+        ldax(state, state->de); 
 	break; 
 
     case 0x1b: 
-        dcx(&state->d, &state->e); 
+        dcx(&state->de); 
 	break; 
 
     case 0x1c:
@@ -619,7 +666,7 @@ int emulate(State8080 *state) {
         break; 
 
     case 0x1e: 
-        mvi(state, &state->h); 
+        mvi(state, &state->e); 
         break;
 
     case 0x1f: 
@@ -630,7 +677,7 @@ int emulate(State8080 *state) {
 	break; 
 
     case 0x21: 
-	lxi(state, &state->h, &state->l); 
+	lxi(state, &state->hl); 
 	break; 
 
     case 0x22: 
@@ -638,7 +685,7 @@ int emulate(State8080 *state) {
 	break;
 
     case 0x23: 
-	inx(&state->h, &state->l); 
+	inx(&state->hl); 
 	break; 
 
     case 0x24: 
@@ -650,7 +697,7 @@ int emulate(State8080 *state) {
 	break;
 
     case 0x26: 
-        mvi(state, &state->l); 
+        mvi(state, &state->h); 
 	break; 
 
     case 0x27: 
@@ -661,7 +708,7 @@ int emulate(State8080 *state) {
 	break; 
 
     case 0x29:
-	dad(state, &state->h, &state->l, &state->h, &state->l); 
+	dad(state, state->hl); 
 	break;
 
     case 0x2a:
@@ -669,7 +716,7 @@ int emulate(State8080 *state) {
 	break; 
 
     case 0x2b:
-	dcx(&state->h, &state->l); 
+	dcx(&state->hl); 
 	break; 
 
     case 0x2c: 
@@ -704,15 +751,15 @@ int emulate(State8080 *state) {
 	break;
 
     case 0x34: 
-        inr_memory(state, &state->h, &state->l); 
+        inr_memory(state, state->hl); 
 	break; 
 
     case 0x35:
-	dcr_memory(state, &state->h, &state->l); 
+	dcr_memory(state, state->hl); 
 	break;
 
     case 0x36:
-        mvi_memory(state, &state->h, &state->l); 
+        mvi_memory(state, state->hl); 
 	break;
 
     case 0x37:
@@ -722,10 +769,8 @@ int emulate(State8080 *state) {
     case 0x38:
 	break;
 
-    case 0x39:; 
-	uint8_t temp1 = state->sp >> 8; 
-	uint8_t temp2 = state->sp & 0xff; 
-	dad(state, &state->h, &state->l, &temp1, &temp2); 
+    case 0x39:
+	dad(state, state->sp); 
 	break;
     
     case 0x3a:
@@ -752,523 +797,18 @@ int emulate(State8080 *state) {
 	cmc(state);
 	break;
 
-    case 0x40:
-	state->b = state->b; 
-	break; 
- 
-    case 0x41:
-	state->b = state->c; 
-	break; 
-
-    case 0x42:
-	state->b = state->d; 
-	break; 
-
-    case 0x43:
-	state->b = state->e; 
-	break;
-
-    case 0x44: 
-	state->b = state->h; 
-	break; 
-
-    case 0x45:
-	state->b = state->l; 
-	break; 
-
-    case 0x46: 
-	state->b = state->memory[make_word(state->h, state->l)]; 
-	break; 
-
-    case 0x47:
-	state->b = state->a; 
-	break;
-
-    case 0x48:
-	state->c = state->b; 
-	break;
-
-    case 0x49:
-        state->c = state->c; 	
-	break;
-
-    case 0x4a: 
-	state->c = state->d;
-	break; 
-
-    case 0x4b: 
-	state->c = state->e;
-	break;
-
-    case 0x4c: 
-	state->c = state->h; 
-	break; 
-
-    case 0x4d:
-	state->c = state->l; 
-	break;
-
-    case 0x4e:
-	state->c = state->memory[make_word(state->h, state->l)]; 
-	break; 
-
-    case 0x4f:
-	state->c = state->a; 
-	break; 
-
-    case 0x50:
-        state->d = state->b;	
-	break;
-
-    case 0x51:
-	state->d = state->c;
-	break;
-
-    case 0x52:
-	state->d = state->d; 
-	break; 
-
-    case 0x53:
-        state->d = state->e; 	
-	break;
-
-    case 0x54: 
-	state->d = state->h; 
-	break; 
-
-    case 0x55: 
-	state->d = state->l; 
-	break; 
-
-    case 0x56:
-	state->d = state->memory[make_word(state->h, state->l)]; 
-	break; 
-
-    case 0x57:
-	state->d = state->a;
-	break;
-
-    case 0x58:
-	state->e = state->b; 
-	break; 
-
-    case 0x59:
-	state->e = state->c; 
-	break; 
-
-    case 0x5a:
-	state->e = state->d; 
-	break; 
-
-    case 0x5b:
-	state->e = state->e; 
-	break; 
-
-    case 0x5c:
-	state->e = state->h; 
-	break; 
-
-    case 0x5d: 
-	state->e = state->l; 
-	break; 
-
-    case 0x5e: 
-	state->e = state->memory[make_word(state->h, state->l)]; 
-	break; 
-
-    case 0x5f: 
-	state->e = state->a; 
-	break; 
-
-    case 0x60: 
-	state->h = state->b; 
-	break; 
-
-    case 0x61:
-	state->h = state->c; 
-	break; 
-
-    case 0x62: 
-	state->h = state->d; 
-	break; 
-
-    case 0x63:
-	state->h = state->e; 
-	break; 
-
-    case 0x64:
-	state->h = state->h; 
-	break; 
-
-    case 0x65:
-	state->h = state->l; 
-	break; 
-
-    case 0x66:
-	state->h = state->memory[make_word(state->h, state->l)]; 
-	break; 
-
-    case 0x67:
-	state->h = state->a; 
-	break;
-
-    case 0x68:
-        state->l = state->b;	
-	break;
-
-    case 0x69:
-	state->l = state->c; 
-	break; 
-
-    case 0x6a: 
-	state->l = state->d; 
-	break; 
-
-    case 0x6b:
-	state->l = state->e; 
-	break; 
-
-    case 0x6c:
-	state->l = state->h; 
-	break; 
-
-    case 0x6d:
-	state->l = state->l; 
-	break; 
-
-    case 0x6e: 
-	state->l = state->memory[make_word(state->h, state->l)]; 
-	break; 
-
-    case 0x6f: 
-	state->l = state->a; 
-	break; 
-
-    case 0x70: 
-	state->memory[make_word(state->h, state->l)] = state->b; 
-	break; 
-
-    case 0x71: 
-	state->memory[make_word(state->h, state->l)] = state->c; 
-	break; 
-
-    case 0x72:
-        state->memory[make_word(state->h, state->l)] = state->d;	
-	break;
-
-    case 0x73:
-        state->memory[make_word(state->h, state->l)] = state->e; 	
-	break;
-
-    case 0x74:
-        state->memory[make_word(state->h, state->l)] = state->h; 	
-	break;
-
-    case 0x75:
-	state->memory[make_word(state->h, state->l)] = state->l; 
-	break; 
-
-    case 0x76:
-	break;
-
-    case 0x77:
-	state->memory[make_word(state->h, state->l)] = state->a; 
-	break; 
-
-    case 0x78:
-	state->a = state->b; 
-	break; 
-
-    case 0x79:
-	state->a = state->c; 
-	break; 
-
-    case 0x7a:
-	state->a = state->d; 
-	break;
-
-    case 0x7b:
-	state->a = state->e; 
-	break;
-
-    case 0x7c:
-	state->a = state->h; 
-	break; 
-
-    case 0x7d:
-	state->a = state->l; 
-	break; 
-
-    case 0x7e: 
-	state->a = state->memory[make_word(state->h, state->l)]; 
-	break; 
-        
-    case 0x7f:
-	state->a = state->a;
-	break;
-
-    case 0x80:
-        add(state, &state->a, &state->b); 	
-	break;
-
-    case 0x81:
-	add(state, &state->a, &state->c);
-	break;
-
-    case 0x82:
-	add(state, &state->a, &state->d);
-	break; 
-
-    case 0x83:
-	add(state, &state->a, &state->e); 
-	break; 
-
-    case 0x84:
-	add(state, &state->a, &state->h);
-	break; 
-
-    case 0x85:
-	add(state, &state->a, &state->l); 
-	break; 
-
-    case 0x86:
-	add(state, &state->a, &state->memory[make_word(state->h, state->l)]); 
-	break; 
-
-    case 0x87:
-	add(state, &state->a, &state->a); 
-	break;
-
-    case 0x88:
-        adc(state, &state->a, &state->b);
-        break;	
-
-    case 0x89:
-	adc(state, &state->a, &state->c); 
-	break; 
-
-    case 0x8a:
-	adc(state, &state->a, &state->d);
-	break; 
-
-    case 0x8b:
-	adc(state, &state->a, &state->e); 
-	break; 
-
-    case 0x8c:
-	adc(state, &state->a, &state->h); 
-	break; 
-
-    case 0x8d:
-	adc(state, &state->a, &state->l);
-	break; 
-
-    case 0x8e:
-	adc(state, &state->a, &state->memory[make_word(state->h, state->l)]);
-	break;
-
-    case 0x8f:
-	adc(state, &state->a, &state->a);
-	break; 
-
-    case 0x90:
-	sub(state, state->b); 
-	break; 
-
-    case 0x91:
-	sub(state, state->c); 
-	break;
-
-    case 0x92:
-	sub(state, state->d); 
-	break; 
-
-    case 0x93:
-	sub(state, state->e); 
-	break; 
-    
-    case 0x94:
-	sub(state, state->h); 
-	break; 
-
-    case 0x95:
-	sub(state, state->l); 
-	break; 
-
-    case 0x96: 
-	sub(state, state->memory[make_word(state->h, state->l)]); 
-	break; 
-
-    case 0x97:
-	sub(state, state->a); 
-	break;
-
-    case 0x98:
-	sbb(state, state->b); 
-	break; 
-
-    case 0x99:
-	sbb(state, state->c); 
-	break; 
-
-    case 0x9a:
-	sbb(state, state->d); 
-	break; 
-
-    case 0x9b:
-	sbb(state, state->e); 
-	break; 
-
-    case 0x9c:
-	sbb(state, state->h); 
-	break; 
-
-    case 0x9d:
-	sbb(state, state->l); 
-	break; 
-
-    case 0x9e:
-	sbb(state, state->memory[make_word(state->h, state->l)]); 
-	break; 
-
-    case 0x9f:
-	sbb(state, state->a);
-	break;
-
-    case 0xa0:
-	ana(state, state->b); 
-	break; 
-
-    case 0xa1:
-	ana(state, state->c); 
-	break; 
-
-    case 0xa2:
-	ana(state, state->d); 
-	break; 
-
-    case 0xa3:
-	ana(state, state->e); 
-	break; 
-
-    case 0xa4:
-	ana(state, state->h); 
-	break; 
-
-    case 0xa5:
-	ana(state, state->l); 
-	break; 
-
-    case 0xa6:
-	ana(state, state->memory[make_word(state->h, state->l)]); 
-	break; 
-
-    case 0xa7:
-	ana(state, state->a); 
-	break; 
-
-    case 0xa8:
-	xra(state, state->b); 
-	break; 
-
-    case 0xa9:
-	xra(state, state->c); 
-	break; 
-
-    case 0xaa:
-	xra(state, state->d); 
-	break; 
-
-    case 0xab:
-	xra(state, state->e); 
-	break; 
-
-    case 0xac:
-	xra(state, state->h); 
-	break; 
-
-    case 0xad:
-	xra(state, state->l); 
-	break; 
-
-    case 0xae:
-	xra(state, state->memory[make_word(state->h, state->l)]); 
-	break; 
-
-    case 0xaf:
-	xra(state, state->a); 
-	break;
-
-    case 0xb0:
-	ora(state, state->b); 
-	break; 
-	
-    case 0xb1:
-	ora(state, state->c); 
-	break; 
-
-    case 0xb2:
-	ora(state, state->d);
-	break; 
-
-    case 0xb3:
-	ora(state, state->e); 
-        break; 
-
-    case 0xb4:
-	ora(state, state->h); 
-        break; 
-
-    case 0xb5:
-	ora(state, state->l); 
-        break; 
-
-    case 0xb6:
-	ora(state, state->memory[make_word(state->h, state->l)]); 
-	break; 
-    
-    case 0xb7:
-        ora(state, state->a); 
-        break; 
-
-    case 0xb8:
-	cmp(state, state->b); 
-	break;
-
-    case 0xb9:
-	cmp(state, state->c); 
-	break; 
-
-    case 0xba:
-	cmp(state, state->d); 
-	break; 
-
-    case 0xbb:
-	cmp(state, state->e); 
-	break; 
-
-    case 0xbc:
-	cmp(state, state->h); 
-	break; 
-
-    case 0xbd:
-	cmp(state, state->l); 
-	break; 
-
-    case 0xbe:
-	cmp(state, state->memory[make_word(state->h, state->l)]);
-	break; 
+    // 0x40 - 0x7f: MOV dst,src, except 0x76 where MOV M,M would be is HLT
+    REGISTERS(MOV_ROW)
 
-    case 0xbf:
-	cmp(state, state->a); 
-	break; 
+    // 0x80 - 0xbf: ALU operation on A and src
+    ALU_OPS(ALU_ROW)
 
     case 0xc0:
-	ret_cond(state, !state->cc.z); 
+	if(ret_cond(state, !state->cc.z)) cycles += COND_TAKEN_CYCLES; 
 	break;
 
     case 0xc1:
-	pop_pair(state, &state->c, &state->b); 
+	pop_pair(state, &state->bc); 
 	break;
 
     case 0xc2:
@@ -1280,16 +820,15 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xc4:
-	call_adr(state, next_word(state)); 
+	if(call_cond(state, !state->cc.z)) cycles += COND_TAKEN_CYCLES; 
 	break; 
 
     case 0xc5:
-	push_word(state, make_word(state->c, state->b)); 
+	push_word(state, state->bc); 
 	break; 
 
-    case 0xc6:;
-	uint8_t next = next_byte(state); 
-	add(state, &state->a, &next); 
+    case 0xc6:
+	add(state, next_byte(state)); 
 	break;
     
     case 0xc7:
@@ -1297,7 +836,7 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xc8:
-	ret_cond(state, state->cc.z); 
+	if(ret_cond(state, state->cc.z)) cycles += COND_TAKEN_CYCLES; 
 	break;	
 
     case 0xc9:
@@ -1309,19 +848,19 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xcb:
+	jmp(state, next_word(state)); 
 	break;
 
     case 0xcc:
-	call_cond(state, state->cc.z);
+	if(call_cond(state, state->cc.z)) cycles += COND_TAKEN_CYCLES;
 	break;
 
     case 0xcd:
 	call_adr(state, next_word(state)); 
 	break;
 
-    case 0xce:;
-	uint8_t data = next_byte(state) + state->cc.cy; 
-	add(state, &state->a, &data); 
+    case 0xce:
+	adc(state, next_byte(state)); 
 	break;
 
     case 0xcf:
@@ -1329,11 +868,11 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xd0:
-	ret_cond(state, !state->cc.cy);
+	if(ret_cond(state, !state->cc.cy)) cycles += COND_TAKEN_CYCLES;
 	break;	
 
     case 0xd1:
-	pop_pair(state, &state->e, &state->d);
+	pop_pair(state, &state->de);
 	break;
 
     case 0xd2:
@@ -1341,20 +880,21 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xd3:
-	next_byte(state); 
+	state->out_port = next_byte(state); 
+	state->out_value = state->a; 
+	state->out_written = 1; 
 	break;
 
     case 0xd4:
-	call_cond(state, !state->cc.cy); 
+	if(call_cond(state, !state->cc.cy)) cycles += COND_TAKEN_CYCLES; 
 	break; 
 
     case 0xd5:
-	push_word(state, make_word(state->e, state->d)); 
+	push_word(state, state->de); 
 	break;
 
-    case 0xd6:;
-    	uint8_t data2 = next_byte(state); 
-    	add(state, &state->a, &data2);  
+    case 0xd6:
+    	sub(state, next_byte(state)); 
     	break;
 
     case 0xd7:
@@ -1362,10 +902,11 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xd8:
-	ret_cond(state, state->cc.cy);
+	if(ret_cond(state, state->cc.cy)) cycles += COND_TAKEN_CYCLES;
 	break;
 
     case 0xd9:
+	ret(state); 
 	break;
 
     case 0xda:
@@ -1377,10 +918,11 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xdc:
-	call_cond(state, state->cc.cy);
+	if(call_cond(state, state->cc.cy)) cycles += COND_TAKEN_CYCLES;
 	break;
 
     case 0xdd:
+	call_adr(state, next_word(state)); 
 	break;
 
     case 0xde:
@@ -1392,28 +934,32 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xe0:
-	ret_cond(state, !state->cc.p); 
+	if(ret_cond(state, !state->cc.p)) cycles += COND_TAKEN_CYCLES; 
 	break;
 
     case 0xe1:
-	pop_pair(state, &state->h, &state->l); 
+	pop_pair(state, &state->hl); 
 	break;
 
     case 0xe2:
 	jmp_cond(state, !state->cc.p); 
 	break;
 
-    case 0xe3:
-	swap_ptr(&state->l, &state->memory[state->sp]); 
-	swap_ptr(&state->h, &state->memory[state->sp+1]);
+    case 0xe3:;
+	uint8_t stack_lo = MEM_READ(state, state->sp); 
+	uint8_t stack_hi = MEM_READ(state, state->sp + 1); 
+	MEM_WRITE(state, state->sp, state->l); 
+	MEM_WRITE(state, (uint16_t) (state->sp + 1), state->h); 
+	state->l = stack_lo; 
+	state->h = stack_hi; 
 	break;
 
     case 0xe4:
-	call_cond(state, !state->cc.p);
+	if(call_cond(state, !state->cc.p)) cycles += COND_TAKEN_CYCLES;
 	break;
 
     case 0xe5:
-	push_word(state, make_word(state->h, state->l)); 
+	push_word(state, state->hl); 
 	break;
 
     case 0xe6:
@@ -1425,11 +971,11 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xe8:
-	ret_cond(state, state->cc.p); 
+	if(ret_cond(state, state->cc.p)) cycles += COND_TAKEN_CYCLES; 
 	break;
 
     case 0xe9:
-	state->pc = make_word(state->h, state->l); 
+	state->pc = state->hl; 
 	break;
 
     case 0xea:
@@ -1437,15 +983,15 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xeb:
-	swap_ptr(&state->h, &state->d); 
-	swap_ptr(&state->l, &state->e);
+	swap_pair(&state->hl, &state->de); 
 	break;
 
     case 0xec:
-	call_cond(state, state->cc.p);
+	if(call_cond(state, state->cc.p)) cycles += COND_TAKEN_CYCLES;
 	break;
 
     case 0xed:
+	call_adr(state, next_word(state)); 
 	break;
 
     case 0xee:
@@ -1457,15 +1003,15 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xf0:
-	ret_cond(state, state->cc.s == 0); 
+	if(ret_cond(state, state->cc.s == 0)) cycles += COND_TAKEN_CYCLES; 
 	break;
 
     case 0xf1:;
-	uint8_t stack_ptr; 
-	uint8_t acc_ptr; 
-	pop_pair(state, &acc_ptr, &stack_ptr); 
+	uint16_t psw; 
+	pop_pair(state, &psw); 
+	uint8_t stack_ptr = psw & 0xff; 
 
-	state->a = acc_ptr; 
+	state->a = psw >> 8; 
 
 	state->cc.s = (stack_ptr & (1 << 7)) > 0; 
 	state->cc.z = (stack_ptr & (1 << 6)) > 0;
@@ -1479,23 +1025,25 @@ int emulate(State8080 *state) {
         break;	
 
     case 0xf3:
+	state->int_enable = 0; 
 	break;
 
     case 0xf4:
-	call_cond(state, !state->cc.s); 
+	if(call_cond(state, !state->cc.s)) cycles += COND_TAKEN_CYCLES; 
 	break;
 
     case 0xf5:
-	state->memory[state->sp-1] = state->a; 
+	MEM_WRITE(state, (uint16_t) (state->sp - 1), state->a); 
 
 	uint8_t flags = 0x0;
 	flags |= state->cc.cy; 
 	flags |= (1 << 1); 
 	flags |= (state->cc.p << 2); 
 	flags |= (state->cc.ac << 4); 
+	flags |= (state->cc.z << 6); 
 	flags |= (state->cc.s << 7); 
 	
-	state->memory[state->sp-2] = flags; 
+	MEM_WRITE(state, (uint16_t) (state->sp - 2), flags); 
 	state->sp += -2; 
 	break;
 
@@ -1508,11 +1056,11 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xf8:
-	ret_cond(state, state->cc.s); 
+	if(ret_cond(state, state->cc.s)) cycles += COND_TAKEN_CYCLES; 
 	break;
 
     case 0xf9:
-	state->sp = make_word(state->h, state->l); 
+	state->sp = state->hl; 
 	break;
 
     case 0xfa:
@@ -1520,13 +1068,16 @@ int emulate(State8080 *state) {
 	break;
 
     case 0xfb:
+	state->int_enable = 1; 
+	state->int_delay = 1; 
 	break;
 
     case 0xfc:
-	call_cond(state, state->cc.s);
+	if(call_cond(state, state->cc.s)) cycles += COND_TAKEN_CYCLES;
 	break;
 
     case 0xfd:
+	call_adr(state, next_word(state)); 
 	break;
 
     case 0xfe:
@@ -1539,7 +1090,6 @@ int emulate(State8080 *state) {
 	
   }
    
-  state->pc += 1; 
-  return 0; 
+  return cycles; 
 }
 
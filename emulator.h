@@ -13,21 +13,92 @@ typedef struct ConditionCodes {
   uint8_t pad:3; 
 } ConditionCodes; 
 
+/*
+ * a register pair is one 16 bit word whose halves are also the two 8 bit
+ * registers, high register first in the name (BC: b high, c low)
+ */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define REGISTER_PAIR(pair, hi, lo) union { uint16_t pair; struct { uint8_t hi; uint8_t lo; }; }
+#else
+#define REGISTER_PAIR(pair, hi, lo) union { uint16_t pair; struct { uint8_t lo; uint8_t hi; }; }
+#endif
+
 typedef struct State8080 {
   uint8_t a; 
-  uint8_t b; 
-  uint8_t c; 
-  uint8_t d; 
-  uint8_t e; 
-  uint8_t h;
-  uint8_t l; 
+  REGISTER_PAIR(bc, b, c); 
+  REGISTER_PAIR(de, d, e); 
+  REGISTER_PAIR(hl, h, l); 
   uint16_t sp; 
   uint16_t pc; 
   uint8_t *memory; 
   struct ConditionCodes cc; 
   uint8_t int_enable;  
+  // the last instruction was EI, which enables interrupts only after the
+  // instruction following it. Every core clears it when it starts and
+  // returns right after an EI with it set (see interrupt.h)
+  uint8_t int_delay; 
+  // the last OUT, port and the byte from A, until a device takes it and
+  // clears out_written. emulate() and emulate_batch() return right after
+  // one, so a scheduler hands it on at the cycle it happened (see sched.h)
+  uint8_t out_port; 
+  uint8_t out_value; 
+  uint8_t out_written; 
+  // stores land only where (adr & write_mask) == write_base, the rest are
+  // dropped as a board's decoder drops writes to ROM. Both 0, as after a
+  // memset, leave all of memory writable
+  uint16_t write_mask; 
+  uint16_t write_base; 
 } State8080; 
 
+/*
+ * memory buffers hold the 64 KiB address space followed by guard bytes
+ * that mirror its bottom, so a word or wider access starting near 0xffff
+ * reads the wrapped bytes without masking its address. Allocate
+ * MEMORY_ALLOC bytes and call memory_sync_guard() after filling the
+ * bottom of memory by hand, the core keeps the mirror current itself
+ */
+#define MEMORY_SIZE (1 << 16)
+#define MEMORY_GUARD 16
+#define MEMORY_ALLOC (MEMORY_SIZE + MEMORY_GUARD)
+
+/*
+ * store a byte and its mirror, for addresses above the guard the second
+ * store repeats the first so there is no branch
+ */
+static inline void memory_write(uint8_t *memory, uint16_t adr, uint8_t val){
+  memory[adr] = val;
+  memory[adr + ((adr < MEMORY_GUARD) << 16)] = val;
+}
+
+void memory_sync_guard(uint8_t *memory);
+
+/*
+ * whether a store to adr lands, see write_mask
+ */
+static inline int memory_writable(const State8080 *state, uint16_t adr){
+  return (adr & state->write_mask) == state->write_base;
+}
+
+/*
+ * every access the cores make to emulated memory goes through these,
+ * building with -DMEMTRACE counts them per address (see memtrace.h)
+ */
+#ifdef MEMTRACE
+#include "memtrace.h"
+#define MEMORY_READ(memory, adr) memtrace_read((memory), (adr))
+#define MEMORY_WRITE(memory, adr, val) memtrace_write((memory), (adr), (val))
+#define MEMORY_FETCH(memory, adr) memtrace_fetch((memory), (adr))
+#else
+#define MEMORY_READ(memory, adr) ((memory)[adr])
+#define MEMORY_WRITE(memory, adr, val) memory_write((memory), (adr), (val))
+#define MEMORY_FETCH(memory, adr) ((memory)[adr])
+#endif
+#define MEM_READ(state, adr) MEMORY_READ((state)->memory, adr)
+// the value is taken even for a dropped store, it may fetch an operand
+#define MEM_WRITE(state, adr, val) do { uint16_t wa_ = (adr); uint8_t wv_ = (val); \
+    if(memory_writable((state), wa_)) MEMORY_WRITE((state)->memory, wa_, wv_); } while(0)
+#define MEM_FETCH(state, adr) MEMORY_FETCH((state)->memory, adr)
+
 uint16_t make_word(uint8_t left, uint8_t right);
 
 uint16_t next_word(State8080 *state); 
@@ -40,25 +111,27 @@ uint8_t next_byte(State8080 *state);
 
 void flags_arithmetic(State8080 *state, uint16_t answer); 
 
-void stax(State8080 *state, uint8_t a, uint8_t b, uint8_t c); 
+int aux_carry(uint8_t a, uint8_t b, int carry_in); 
 
-void inx(uint8_t *a, uint8_t *b); 
+void stax(State8080 *state, uint16_t adr); 
+
+void inx(uint16_t *pair); 
 
 void inr(State8080 *state, uint8_t *a);
 
 void dcr(State8080 *state, uint8_t *a); 
 
-void lxi(State8080 *state, uint8_t *a, uint8_t *b); 
+void lxi(State8080 *state, uint16_t *pair); 
 
 void mvi(State8080 *state, uint8_t *a); 
 
 void rlc(State8080 *state); 
 
-void dad(State8080 *state, uint8_t *a, uint8_t *b, uint8_t *c, uint8_t *d);
+void dad(State8080 *state, uint16_t pair);
 
-void ldax(State8080 *state, uint8_t *a, uint8_t *b, uint8_t *c); 
+void ldax(State8080 *state, uint16_t adr); 
 
-void dcx(uint8_t *a, uint8_t *b); 
+void dcx(uint16_t *pair); 
 
 void rrc(State8080 *state); 
 
@@ -80,11 +153,11 @@ void sta(State8080 *state, uint8_t *a);
 
 void inx_sp(State8080 *state); 
 
-void inr_memory(State8080 *state, uint8_t *a, uint8_t *b);
+void inr_memory(State8080 *state, uint16_t adr);
 
-void dcr_memory(State8080 *state, uint8_t *a, uint8_t *b); 
+void dcr_memory(State8080 *state, uint16_t adr); 
 
-void mvi_memory(State8080 *state, uint8_t *a, uint8_t *b); 
+void mvi_memory(State8080 *state, uint16_t adr); 
 
 void stc(State8080 *state); 
 
@@ -94,9 +167,9 @@ void dcx_sp(State8080 *state);
 
 void cmc(State8080 *state);
 
-void add(State8080 *state, uint8_t *a, uint8_t *b); 
+void add(State8080 *state, uint8_t x); 
 
-void adc(State8080 *state, uint8_t *a, uint8_t *b); 
+void adc(State8080 *state, uint8_t x); 
 
 void sub(State8080 *state, uint8_t x);
 
@@ -112,9 +185,9 @@ void cmp(State8080 *state, uint8_t x);
 
 void ret(State8080 *state); 
 
-void ret_cond(State8080 *state, uint8_t cond); 
+int ret_cond(State8080 *state, uint8_t cond); 
 
-void pop_pair(State8080 *state, uint8_t *hi, uint8_t *lo); 
+void pop_pair(State8080 *state, uint16_t *pair); 
 
 void jmp(State8080 *state, uint16_t adr);
 
@@ -124,9 +197,13 @@ void push_word(State8080 *state, uint16_t word);
 
 void call_adr(State8080 *state, uint16_t adr); 
 
-void swap_ptr(uint8_t *a, uint8_t *b);
+int call_cond(State8080 *state, uint8_t cond); 
+
+void swap_pair(uint16_t *a, uint16_t *b);
+
+int emulate(State8080 *state);
 
-int emulate(State8080 *state); 
+int emulate_batch(State8080 *state, int budget); 
 
 
 
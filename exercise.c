@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "cpm.h"
+
+/*
+ * The 8080 exercisers (8080EXM, 8080PRE style .COM files) walk a table of
+ * test descriptors:
+ *
+ *   LXI H,tests / loop: MOV A,M / INX H / ORA M / JZ done ...
+ *
+ * Each descriptor is independent, so a group is run on its own by patching
+ * the table down to that one entry followed by the terminating zero word.
+ */
+static const uint8_t table_loop[] = {0x7e, 0x23, 0xb6, 0xca};
+
+// descriptor layout: flag mask, base/increment/shift vectors, crc, name
+#define DESC_CRC 61
+#define DESC_NAME 65
+#define MAX_OUTPUT 4096
+
+typedef struct Group {
+  uint16_t descriptor;
+  char name[64];
+  uint32_t expected;
+  char found[16];
+  int passed;
+  int finished;
+  double seconds;
+  uint64_t instructions;
+  char output[MAX_OUTPUT];
+  int output_len;
+} Group;
+
+typedef struct Runner {
+  const uint8_t *image;
+  size_t size;
+  uint16_t table;
+  uint64_t max_instructions;
+  Group *groups;
+  int count;
+  atomic_int next;
+} Runner;
+
+static double now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * find the address of the test table from the loop that walks it,
+ * returns 0 if the image does not look like an exerciser
+ */
+static uint16_t find_table(const uint8_t *image, size_t size){
+  for(size_t i = 0; i + 3 + sizeof(table_loop) <= size; i++){
+    if(image[i] == 0x21 && memcmp(image + i + 3, table_loop, sizeof(table_loop)) == 0){
+      return make_word(image[i + 2], image[i + 1]);
+    }
+  }
+  return 0;
+}
+
+static const uint8_t *at(const Runner *runner, uint16_t adr){
+  return runner->image + (adr - CPM_TPA);
+}
+
+static void collect(void *ctx, char c){
+  Group *group = (Group *) ctx;
+  if(group->output_len < MAX_OUTPUT - 1){
+    group->output[group->output_len++] = c;
+  }
+}
+
+/*
+ * run one group in a fresh machine and judge it from what it printed
+ */
+static void run_group(Runner *runner, Group *group, uint8_t *memory){
+  CpmMachine machine;
+  cpm_init(&machine, memory, collect, group);
+  cpm_load_image(&machine, runner->image, runner->size);
+  memory[runner->table] = group->descriptor & 0xff;
+  memory[runner->table + 1] = group->descriptor >> 8;
+  memory[runner->table + 2] = 0;
+  memory[runner->table + 3] = 0;
+
+  double start = now();
+  group->finished = cpm_run(&machine, runner->max_instructions);
+  group->seconds = now() - start;
+  group->instructions = machine.instructions;
+  group->output[group->output_len] = '\0';
+
+  char *found = strstr(group->output, "found:");
+  if(found){
+    sscanf(found + 6, "%15[0-9a-fA-F]", group->found);
+  }
+  group->passed = group->finished && strstr(group->output, "OK") != NULL && found == NULL;
+}
+
+static void *worker(void *arg){
+  Runner *runner = (Runner *) arg;
+  uint8_t *memory = (uint8_t *) malloc(MEMORY_ALLOC);
+  int i;
+  while((i = atomic_fetch_add(&runner->next, 1)) < runner->count){
+    run_group(runner, &runner->groups[i], memory);
+  }
+  free(memory);
+  return NULL;
+}
+
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-j threads] [-n max_instructions] [-t table_adr] [-v] exerciser.com\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv){
+  Runner runner;
+  memset(&runner, 0, sizeof(runner));
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int verbose = 0;
+  int opt;
+  while((opt = getopt(argc, argv, "j:n:t:v")) != -1){
+    switch(opt){
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      case 'n':
+        runner.max_instructions = atoll(optarg);
+        break;
+      case 't':
+        runner.table = strtol(optarg, NULL, 0);
+        break;
+      case 'v':
+        verbose = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if(optind != argc - 1 || threads < 1){
+    usage(argv[0]);
+  }
+
+  FILE *f = fopen(argv[optind], "rb");
+  if(f == NULL){
+    fprintf(stderr, "could not open %s\n", argv[optind]);
+    return 1;
+  }
+  uint8_t *image = (uint8_t *) calloc(CPM_BDOS_TOP, 1);
+  runner.size = fread(image, 1, CPM_BDOS_TOP - CPM_TPA, f);
+  runner.image = image;
+  fclose(f);
+
+  if(runner.table == 0){
+    runner.table = find_table(image, runner.size);
+  }
+  if(runner.table < CPM_TPA || runner.table >= CPM_TPA + runner.size){
+    fprintf(stderr, "no test table found, pass its address with -t\n");
+    return 1;
+  }
+
+  // read the descriptors the table points at
+  runner.groups = (Group *) calloc(256, sizeof(Group));
+  for(const uint8_t *entry = at(&runner, runner.table); runner.count < 256; entry += 2){
+    uint16_t adr = make_word(entry[1], entry[0]);
+    if(adr == 0){
+      break;
+    }
+    Group *group = &runner.groups[runner.count++];
+    const uint8_t *desc = at(&runner, adr);
+    group->descriptor = adr;
+    group->expected = desc[DESC_CRC] << 24 | desc[DESC_CRC + 1] << 16 | desc[DESC_CRC + 2] << 8 | desc[DESC_CRC + 3];
+    int len = 0;
+    while(len < (int) sizeof(group->name) - 1 && desc[DESC_NAME + len] != '$'){
+      group->name[len] = desc[DESC_NAME + len];
+      len++;
+    }
+  }
+  if(threads > runner.count){
+    threads = runner.count;
+  }
+  printf("%d groups in table at 0x%04x, %d threads\n", runner.count, runner.table, threads);
+
+  double start = now();
+  pthread_t *pool = (pthread_t *) malloc(threads * sizeof(pthread_t));
+  for(int i = 0; i < threads; i++){
+    pthread_create(&pool[i], NULL, worker, &runner);
+  }
+  for(int i = 0; i < threads; i++){
+    pthread_join(pool[i], NULL);
+  }
+  double wall = now() - start;
+
+  int failures = 0;
+  double serial = 0;
+  for(int i = 0; i < runner.count; i++){
+    Group *group = &runner.groups[i];
+    serial += group->seconds;
+    failures += !group->passed;
+    printf("%-32s %-7s expected %08x found %-8s %9.3f s %8.1f MIPS\n", group->name,
+           group->passed ? "ok" : (group->finished ? "FAILED" : "TIMEOUT"),
+           group->expected, group->found[0] ? group->found : (group->passed ? "same" : "-"),
+           group->seconds, group->seconds > 0 ? group->instructions / group->seconds / 1e6 : 0.0);
+    if(verbose || !group->passed){
+      printf("%s\n", group->output);
+    }
+  }
+  printf("%d/%d groups passed, %.3f s wall, %.3f s serial (%.2fx)\n",
+         runner.count - failures, runner.count, wall, serial, wall > 0 ? serial / wall : 0.0);
+
+  free(pool);
+  free(runner.groups);
+  free(image);
+  return failures ? 1 : 0;
+}
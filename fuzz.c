@@ -0,0 +1,524 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cores.h"
+#include "opcodes.h"
+
+/*
+ * Coverage guided fuzzing of the instruction set: an input is an initial
+ * register state followed by a short instruction stream loaded at 0x0000.
+ * Both cores run it in lockstep and any difference in registers, flags,
+ * cycles or memory is a failure, which gets minimized to a reproducer.
+ * Inputs that reach a new (opcode, flags after) pair or a new pair of
+ * consecutive opcodes are kept in the corpus and mutated further.
+ */
+
+// a b c d e h l flags sp_lo sp_hi
+#define FUZZ_STATE 10
+#define FUZZ_CODE_MAX 64
+#define FUZZ_INPUT_MAX (FUZZ_STATE + FUZZ_CODE_MAX)
+#define CORPUS_MAX (1 << 14)
+
+// memory is compared and restored in lines of 64 bytes
+#define LINE_SHIFT 6
+#define LINES (1 << (16 - LINE_SHIFT))
+
+// coverage map: opcode and flags after it, then opcode after opcode
+#define FLAG_SLOTS (256 * 32)
+#define EDGE_SLOTS (256 * 256)
+
+// execute() modes
+#define RUN_FULL 1
+#define RUN_COVERAGE 2
+#define RUN_TRACE 4
+
+typedef struct Input {
+  uint8_t data[FUZZ_INPUT_MAX];
+  int len;
+} Input;
+
+typedef struct Side {
+  const char *name;
+  Core core;
+  State8080 state;
+  uint8_t *memory;
+} Side;
+
+typedef struct Fuzzer {
+  Side a;
+  Side b;
+  // what memory holds outside the input's code
+  uint8_t *base;
+  int steps;
+  uint64_t rng;
+
+  // lines the last input may have written, stamped per execution
+  uint32_t stamp[LINES];
+  uint32_t generation;
+  uint16_t dirty[LINES];
+  int dirty_count;
+
+  uint8_t coverage[FLAG_SLOTS + EDGE_SLOTS];
+  int covered;
+  Input *corpus;
+  int corpus_count;
+
+  uint64_t execs;
+  // where the last failing run went wrong
+  int fail_step;
+  const char *fail_reason;
+} Fuzzer;
+
+static double now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t next_random(Fuzzer *fz){
+  fz->rng ^= fz->rng >> 12;
+  fz->rng ^= fz->rng << 25;
+  fz->rng ^= fz->rng >> 27;
+  return fz->rng * 0x2545f4914f6cdd1dull;
+}
+
+static uint32_t below(Fuzzer *fz, uint32_t n){
+  return next_random(fz) % n;
+}
+
+static void mark_line(Fuzzer *fz, uint16_t adr){
+  int line = adr >> LINE_SHIFT;
+  if(fz->stamp[line] != fz->generation){
+    fz->stamp[line] = fz->generation;
+    fz->dirty[fz->dirty_count++] = line;
+  }
+}
+
+/*
+ * every write an instruction can make is within two bytes of HL, BC, DE,
+ * SP or its own address operand, so marking the lines around those before
+ * each step covers all of memory a correct core can change
+ */
+static void mark_writable(Fuzzer *fz, const State8080 *s){
+  uint16_t operand = s->memory[(uint16_t) (s->pc + 1)] | s->memory[(uint16_t) (s->pc + 2)] << 8;
+  uint16_t targets[] = {s->hl, s->bc, s->de, s->sp, operand};
+  for(size_t i = 0; i < sizeof(targets) / sizeof(*targets); i++){
+    mark_line(fz, targets[i] - 2);
+    mark_line(fz, targets[i] + 1);
+  }
+}
+
+static void load_state(State8080 *s, uint8_t *memory, const Input *in){
+  memset(s, 0, sizeof(*s));
+  s->a = in->data[0];
+  s->b = in->data[1];
+  s->c = in->data[2];
+  s->d = in->data[3];
+  s->e = in->data[4];
+  s->h = in->data[5];
+  s->l = in->data[6];
+  s->cc.z = in->data[7] & 1;
+  s->cc.s = (in->data[7] >> 1) & 1;
+  s->cc.p = (in->data[7] >> 2) & 1;
+  s->cc.cy = (in->data[7] >> 3) & 1;
+  s->cc.ac = (in->data[7] >> 4) & 1;
+  s->sp = make_word(in->data[9], in->data[8]);
+  s->memory = memory;
+}
+
+static void print_state(const char *name, const State8080 *s){
+  printf("  %-8s pc=%04x sp=%04x a=%02x b=%02x c=%02x d=%02x e=%02x h=%02x l=%02x z=%d s=%d p=%d cy=%d ac=%d ie=%d delay=%d out=%d:%02x=%02x\n",
+         name, s->pc, s->sp, s->a, s->b, s->c, s->d, s->e, s->h, s->l,
+         s->cc.z, s->cc.s, s->cc.p, s->cc.cy, s->cc.ac, s->int_enable,
+         s->int_delay, s->out_written, s->out_port, s->out_value);
+}
+
+static void print_instruction(const uint8_t *memory, uint16_t pc){
+  uint8_t opcode = memory[pc];
+  printf("%04x  %02x", pc, opcode);
+  for(int i = 1; i < 3; i++){
+    if(i < opcode_lengths[opcode]){
+      printf(" %02x", memory[(uint16_t) (pc + i)]);
+    }
+    else {
+      printf("   ");
+    }
+  }
+  printf("  %s\n", opcode_names[opcode]);
+}
+
+static int fail(Fuzzer *fz, int step, const char *reason){
+  fz->fail_step = step;
+  fz->fail_reason = reason;
+  return 1;
+}
+
+/*
+ * run one input on both cores, returns 1 if they disagree. Memory is
+ * compared and put back line by line unless mode has RUN_FULL, which
+ * checks and restores the whole address space
+ */
+static int execute(Fuzzer *fz, const Input *in, int mode){
+  Side *a = &fz->a;
+  Side *b = &fz->b;
+  int code_len = in->len - FUZZ_STATE;
+  fz->generation++;
+  fz->dirty_count = 0;
+  memcpy(a->memory, in->data + FUZZ_STATE, code_len);
+  memcpy(b->memory, in->data + FUZZ_STATE, code_len);
+  memory_sync_guard(a->memory);
+  memory_sync_guard(b->memory);
+  for(int adr = 0; adr < code_len; adr += 1 << LINE_SHIFT){
+    mark_line(fz, adr);
+  }
+  mark_line(fz, code_len - 1);
+  load_state(&a->state, a->memory, in);
+  load_state(&b->state, b->memory, in);
+  fz->execs++;
+
+  int failed = 0;
+  uint8_t prev = 0;
+  for(int step = 0; step < fz->steps && !failed; step++){
+    mark_writable(fz, &a->state);
+    mark_writable(fz, &b->state);
+    uint8_t opcode = a->memory[a->state.pc];
+    if(mode & RUN_TRACE){
+      print_instruction(a->memory, a->state.pc);
+    }
+    int cycles_a = a->core(&a->state);
+    int cycles_b = b->core(&b->state);
+
+    if(mode & RUN_COVERAGE){
+      const ConditionCodes *cc = &a->state.cc;
+      int flags = cc->z | cc->s << 1 | cc->p << 2 | cc->cy << 3 | cc->ac << 4;
+      uint32_t slots[] = {opcode << 5 | flags, FLAG_SLOTS + (prev << 8 | opcode)};
+      for(int i = 0; i < 2; i++){
+        if(!fz->coverage[slots[i]]){
+          fz->coverage[slots[i]] = 1;
+          fz->covered++;
+        }
+      }
+      prev = opcode;
+    }
+
+    if(state_signature(&a->state) != state_signature(&b->state)){
+      failed = fail(fz, step, "registers");
+    }
+    else if(cycles_a != cycles_b){
+      failed = fail(fz, step, "cycles");
+    }
+    if(mode & RUN_TRACE){
+      print_state(a->name, &a->state);
+      print_state(b->name, &b->state);
+      if(cycles_a != cycles_b){
+        printf("  cycles   %s=%d %s=%d\n", a->name, cycles_a, b->name, cycles_b);
+      }
+    }
+  }
+
+  if(mode & RUN_FULL){
+    if(!failed && memcmp(a->memory, b->memory, 1 << 16) != 0){
+      failed = fail(fz, fz->steps, "memory");
+    }
+    memcpy(a->memory, fz->base, MEMORY_ALLOC);
+    memcpy(b->memory, fz->base, MEMORY_ALLOC);
+    return failed;
+  }
+  for(int i = 0; i < fz->dirty_count; i++){
+    size_t offset = (size_t) fz->dirty[i] << LINE_SHIFT;
+    if(!failed && memcmp(a->memory + offset, b->memory + offset, 1 << LINE_SHIFT) != 0){
+      failed = fail(fz, fz->steps, "memory");
+    }
+    memcpy(a->memory + offset, fz->base + offset, 1 << LINE_SHIFT);
+    memcpy(b->memory + offset, fz->base + offset, 1 << LINE_SHIFT);
+  }
+  memory_sync_guard(a->memory);
+  memory_sync_guard(b->memory);
+  return failed;
+}
+
+static void add_to_corpus(Fuzzer *fz, const Input *in){
+  if(fz->corpus_count < CORPUS_MAX){
+    fz->corpus[fz->corpus_count++] = *in;
+  }
+  else {
+    fz->corpus[below(fz, CORPUS_MAX)] = *in;
+  }
+}
+
+/*
+ * put an instruction with random operands at offset, if it fits
+ */
+static void insert_instruction(Fuzzer *fz, Input *in, int offset){
+  uint8_t opcode = below(fz, 256);
+  int len = opcode_lengths[opcode];
+  if(in->len + len > FUZZ_INPUT_MAX){
+    return;
+  }
+  memmove(in->data + offset + len, in->data + offset, in->len - offset);
+  in->data[offset] = opcode;
+  for(int i = 1; i < len; i++){
+    in->data[offset + i] = below(fz, 256);
+  }
+  in->len += len;
+}
+
+static void mutate(Fuzzer *fz, Input *in){
+  int count = 1 + below(fz, 4);
+  for(int i = 0; i < count; i++){
+    int code_len = in->len - FUZZ_STATE;
+    int at = FUZZ_STATE + below(fz, code_len);
+    switch(below(fz, 7)){
+      case 0:
+        in->data[below(fz, in->len)] ^= 1 << below(fz, 8);
+        break;
+
+      case 1:
+        in->data[below(fz, in->len)] = below(fz, 256);
+        break;
+
+      case 2:
+        if(in->len < FUZZ_INPUT_MAX){
+          memmove(in->data + at + 1, in->data + at, in->len - at);
+          in->data[at] = below(fz, 256);
+          in->len++;
+        }
+        break;
+
+      case 3:
+        if(code_len > 1){
+          memmove(in->data + at, in->data + at + 1, in->len - at - 1);
+          in->len--;
+        }
+        break;
+
+      case 4:
+        in->data[below(fz, FUZZ_STATE)] = below(fz, 256);
+        break;
+
+      case 5:;
+        // keep our head, take the tail of another input's code
+        const Input *other = &fz->corpus[below(fz, fz->corpus_count)];
+        int from = FUZZ_STATE + below(fz, other->len - FUZZ_STATE);
+        int tail = other->len - from;
+        if(at + tail > FUZZ_INPUT_MAX){
+          tail = FUZZ_INPUT_MAX - at;
+        }
+        memcpy(in->data + at, other->data + from, tail);
+        in->len = at + tail;
+        break;
+
+      default:
+        insert_instruction(fz, in, at);
+        break;
+    }
+  }
+}
+
+/*
+ * shrink a failing input while it keeps failing: drop code bytes, turn
+ * them into NOPs and clear the initial registers
+ */
+static void minimize(Fuzzer *fz, Input *in){
+  int progress = 1;
+  while(progress){
+    progress = 0;
+    for(int i = in->len - 1; i >= FUZZ_STATE && in->len > FUZZ_STATE + 1; i--){
+      Input smaller = *in;
+      memmove(smaller.data + i, smaller.data + i + 1, smaller.len - i - 1);
+      smaller.len--;
+      if(execute(fz, &smaller, RUN_FULL)){
+        *in = smaller;
+        progress = 1;
+      }
+    }
+    for(int i = 0; i < in->len; i++){
+      if(in->data[i] != 0){
+        Input simpler = *in;
+        simpler.data[i] = 0;
+        if(execute(fz, &simpler, RUN_FULL)){
+          *in = simpler;
+          progress = 1;
+        }
+      }
+    }
+  }
+  execute(fz, in, RUN_FULL);
+}
+
+static int write_input(const Input *in, const char *path){
+  FILE *f = fopen(path, "wb");
+  if(f == NULL){
+    return -1;
+  }
+  fwrite(in->data, 1, in->len, f);
+  return fclose(f);
+}
+
+static int read_input(Input *in, const char *path){
+  FILE *f = fopen(path, "rb");
+  if(f == NULL){
+    return -1;
+  }
+  in->len = fread(in->data, 1, FUZZ_INPUT_MAX, f);
+  fclose(f);
+  return in->len > FUZZ_STATE ? 0 : -1;
+}
+
+/*
+ * replay an input instruction by instruction, printing both cores
+ */
+static void trace(Fuzzer *fz, const Input *in){
+  int failed = execute(fz, in, RUN_FULL | RUN_TRACE);
+  if(failed){
+    printf("%s differ after step %d\n", fz->fail_reason, fz->fail_step);
+  }
+  else {
+    printf("%s and %s agree\n", fz->a.name, fz->b.name);
+  }
+}
+
+static void setup(Side *side, const char *name, const uint8_t *base){
+  side->name = name;
+  side->core = find_core(name);
+  side->memory = (uint8_t *) malloc(MEMORY_ALLOC);
+  memcpy(side->memory, base, MEMORY_ALLOC);
+}
+
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-a core] [-b core] [-n execs] [-t seconds] [-s seed] [-S steps] [-o crash.bin] [-F] [-r input.bin]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv){
+  const char *core_a = "emulate";
+  const char *core_b = "ref";
+  uint64_t max_execs = 10000000;
+  double seconds = 0;
+  uint64_t seed = 0;
+  int steps = 32;
+  const char *crash_path = "crash.bin";
+  const char *replay_path = NULL;
+  int full = 0;
+  int opt;
+  while((opt = getopt(argc, argv, "a:b:n:t:s:S:o:Fr:")) != -1){
+    switch(opt){
+      case 'a':
+        core_a = optarg;
+        break;
+      case 'b':
+        core_b = optarg;
+        break;
+      case 'n':
+        max_execs = atoll(optarg);
+        break;
+      case 't':
+        seconds = atof(optarg);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'S':
+        steps = atoi(optarg);
+        break;
+      case 'o':
+        crash_path = optarg;
+        break;
+      case 'F':
+        full = 1;
+        break;
+      case 'r':
+        replay_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if(steps < 1){
+    usage(argv[0]);
+  }
+
+  Fuzzer *fz = (Fuzzer *) calloc(1, sizeof(Fuzzer));
+  fz->steps = steps;
+  fz->rng = seed ? seed : (uint64_t) time(NULL) ^ (uint64_t) getpid() << 32;
+  // a fixed pattern rather than zeros, so loads see varied values
+  fz->base = (uint8_t *) malloc(MEMORY_ALLOC);
+  for(int i = 0; i < MEMORY_SIZE; i++){
+    fz->base[i] = (i * 0x9d) ^ (i >> 8);
+  }
+  memory_sync_guard(fz->base);
+  setup(&fz->a, core_a, fz->base);
+  setup(&fz->b, core_b, fz->base);
+
+  Input in;
+  if(replay_path){
+    if(read_input(&in, replay_path) != 0){
+      fprintf(stderr, "could not read %s\n", replay_path);
+      return 1;
+    }
+    trace(fz, &in);
+    return fz->fail_reason ? 1 : 0;
+  }
+  printf("seed 0x%llx\n", (unsigned long long) fz->rng);
+
+  // one seed input per opcode
+  fz->corpus = (Input *) malloc(CORPUS_MAX * sizeof(Input));
+  for(int op = 0; op < 256; op++){
+    in.len = FUZZ_STATE;
+    for(int i = 0; i < FUZZ_STATE; i++){
+      in.data[i] = below(fz, 256);
+    }
+    in.data[in.len++] = op;
+    for(int i = 1; i < opcode_lengths[op]; i++){
+      in.data[in.len++] = below(fz, 256);
+    }
+    execute(fz, &in, RUN_COVERAGE);
+    add_to_corpus(fz, &in);
+  }
+
+  int mode = RUN_COVERAGE | (full ? RUN_FULL : 0);
+  int failed = 0;
+  double start = now();
+  double report = start + 1;
+  while(fz->execs < max_execs){
+    in = fz->corpus[below(fz, fz->corpus_count)];
+    mutate(fz, &in);
+    int covered = fz->covered;
+    if(execute(fz, &in, mode)){
+      failed = 1;
+      break;
+    }
+    if(fz->covered > covered){
+      add_to_corpus(fz, &in);
+    }
+    if((fz->execs & 0xfff) == 0){
+      double t = now();
+      if(seconds > 0 && t - start >= seconds){
+        break;
+      }
+      if(t >= report){
+        fprintf(stderr, "execs %llu, %.0f exec/s, corpus %d, coverage %d\n",
+                (unsigned long long) fz->execs, fz->execs / (t - start), fz->corpus_count, fz->covered);
+        report = t + 1;
+      }
+    }
+  }
+  double elapsed = now() - start;
+  printf("%llu execs in %.2f s, %.0f exec/s per core, corpus %d, coverage %d/%d\n",
+         (unsigned long long) fz->execs, elapsed, elapsed > 0 ? fz->execs / elapsed : 0.0,
+         fz->corpus_count, fz->covered, FLAG_SLOTS + EDGE_SLOTS);
+
+  if(failed){
+    printf("%s differ after step %d, minimizing %d bytes\n", fz->fail_reason, fz->fail_step, in.len);
+    minimize(fz, &in);
+    printf("reproducer of %d bytes", in.len);
+    if(write_input(&in, crash_path) == 0){
+      printf(" written to %s, replay it with -r", crash_path);
+    }
+    printf("\n");
+    trace(fz, &in);
+  }
+  return failed;
+}
@@ -0,0 +1,198 @@
+#include <string.h>
+#include "hash.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+#define PRIME32_1 0x9e3779b1u
+#define PRIME64_1 0x9e3779b185ebca87ull
+#define STRIPE 64
+#define BLOCK_STRIPES 16
+
+/*
+ * stripe n of a block is mixed with the key from lane n on, the scramble
+ * after a block uses the last eight lanes. splitmix64 of 0x8080
+ */
+static const uint64_t key[BLOCK_STRIPES + 8] = {
+  0x9add6f0d116a7172ull, 0x0dcc3989cd6a9dc4ull, 0xf98117001d1c00b0ull,
+  0xbcf4e0ab46f3b4cfull, 0x8e95d013c0151b6aull, 0x2af388e109ddcc7cull,
+  0x35af6f98b7393821ull, 0x06953da37e357b3aull, 0xae9e30cf1bc998fbull,
+  0x09613df7e0440e52ull, 0xd8ec2ba0e299a925ull, 0x8ab32dc6fde147dbull,
+  0xfaa5f1fb637bbbfaull, 0x7152b5c7ecdac0f5ull, 0x28c035dd64d8ce8dull,
+  0x30c64ab2fb047e0dull, 0xdef50f38700e52b8ull, 0x4060cf538e598e7full,
+  0x300275df18889c67ull, 0x39d3fc78f2744708ull, 0x30f576e520a47183ull,
+  0xc0b505888bd1d9e4ull, 0x7fdd053170cc3787ull, 0xa2d2df97c469d22dull,
+};
+
+/*
+ * accumulate stripes first up to end, stripe n at data + (n - first) * 64
+ */
+typedef void (*StripeLoop)(uint64_t *acc, const uint8_t *data, size_t first, size_t end);
+
+static void scalar_stripes(uint64_t *acc, const uint8_t *data, size_t first, size_t end){
+  for(size_t n = first; n < end; n++, data += STRIPE){
+    const uint64_t *k = key + n % BLOCK_STRIPES;
+    for(int i = 0; i < 8; i++){
+      uint64_t d;
+      memcpy(&d, data + 8 * i, 8);
+      uint64_t dk = d ^ k[i];
+      acc[i ^ 1] += d;
+      acc[i] += (dk & 0xffffffff) * (dk >> 32);
+    }
+    if(n % BLOCK_STRIPES == BLOCK_STRIPES - 1){
+      for(int i = 0; i < 8; i++){
+        acc[i] = (acc[i] ^ (acc[i] >> 47) ^ key[BLOCK_STRIPES + i]) * PRIME32_1;
+      }
+    }
+  }
+}
+
+#ifdef HAVE_X86
+static void sse2_stripes(uint64_t *acc, const uint8_t *data, size_t first, size_t end){
+  __m128i a[4];
+  for(int j = 0; j < 4; j++){
+    a[j] = _mm_loadu_si128((const __m128i *) acc + j);
+  }
+  const __m128i prime = _mm_set1_epi32(PRIME32_1);
+  for(size_t n = first; n < end; n++, data += STRIPE){
+    const __m128i *k = (const __m128i *) (key + n % BLOCK_STRIPES);
+    for(int j = 0; j < 4; j++){
+      __m128i d = _mm_loadu_si128((const __m128i *) data + j);
+      __m128i dk = _mm_xor_si128(d, _mm_loadu_si128(k + j));
+      // the high halves of each lane under the low ones for the multiply
+      __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, 0x31));
+      a[j] = _mm_add_epi64(a[j], _mm_add_epi64(product, _mm_shuffle_epi32(d, 0x4e)));
+    }
+    if(n % BLOCK_STRIPES == BLOCK_STRIPES - 1){
+      const __m128i *s = (const __m128i *) (key + BLOCK_STRIPES);
+      for(int j = 0; j < 4; j++){
+        __m128i x = _mm_xor_si128(_mm_xor_si128(a[j], _mm_srli_epi64(a[j], 47)), _mm_loadu_si128(s + j));
+        __m128i high = _mm_mul_epu32(_mm_shuffle_epi32(x, 0x31), prime);
+        a[j] = _mm_add_epi64(_mm_mul_epu32(x, prime), _mm_slli_epi64(high, 32));
+      }
+    }
+  }
+  for(int j = 0; j < 4; j++){
+    _mm_storeu_si128((__m128i *) acc + j, a[j]);
+  }
+}
+
+__attribute__((target("avx2")))
+static void avx2_stripes(uint64_t *acc, const uint8_t *data, size_t first, size_t end){
+  __m256i a[2];
+  for(int j = 0; j < 2; j++){
+    a[j] = _mm256_loadu_si256((const __m256i *) acc + j);
+  }
+  const __m256i prime = _mm256_set1_epi32(PRIME32_1);
+  for(size_t n = first; n < end; n++, data += STRIPE){
+    const __m256i *k = (const __m256i *) (key + n % BLOCK_STRIPES);
+    for(int j = 0; j < 2; j++){
+      __m256i d = _mm256_loadu_si256((const __m256i *) data + j);
+      __m256i dk = _mm256_xor_si256(d, _mm256_loadu_si256(k + j));
+      __m256i product = _mm256_mul_epu32(dk, _mm256_shuffle_epi32(dk, 0x31));
+      a[j] = _mm256_add_epi64(a[j], _mm256_add_epi64(product, _mm256_shuffle_epi32(d, 0x4e)));
+    }
+    if(n % BLOCK_STRIPES == BLOCK_STRIPES - 1){
+      const __m256i *s = (const __m256i *) (key + BLOCK_STRIPES);
+      for(int j = 0; j < 2; j++){
+        __m256i x = _mm256_xor_si256(_mm256_xor_si256(a[j], _mm256_srli_epi64(a[j], 47)), _mm256_loadu_si256(s + j));
+        __m256i high = _mm256_mul_epu32(_mm256_shuffle_epi32(x, 0x31), prime);
+        a[j] = _mm256_add_epi64(_mm256_mul_epu32(x, prime), _mm256_slli_epi64(high, 32));
+      }
+    }
+  }
+  for(int j = 0; j < 2; j++){
+    _mm256_storeu_si256((__m256i *) acc + j, a[j]);
+  }
+}
+#endif
+
+typedef struct Implementation {
+  const char *name;
+  StripeLoop stripes;
+} Implementation;
+
+// widest first
+static const Implementation implementations[] = {
+#ifdef HAVE_X86
+  {"avx2", avx2_stripes},
+  {"sse2", sse2_stripes},
+#endif
+  {"scalar", scalar_stripes},
+};
+
+static const Implementation *current = &implementations[sizeof(implementations) / sizeof(*implementations) - 1];
+
+static int supported(const Implementation *impl){
+#ifdef HAVE_X86
+  if(impl->stripes == avx2_stripes){
+    return __builtin_cpu_supports("avx2");
+  }
+  if(impl->stripes == sse2_stripes){
+    return __builtin_cpu_supports("sse2");
+  }
+#endif
+  return 1;
+}
+
+__attribute__((constructor))
+static void hash_select(void){
+#ifdef HAVE_X86
+  __builtin_cpu_init();
+#endif
+  for(size_t i = 0; i < sizeof(implementations) / sizeof(*implementations); i++){
+    if(supported(&implementations[i])){
+      current = &implementations[i];
+      return;
+    }
+  }
+}
+
+const char *hash_implementation(void){
+  return current->name;
+}
+
+int hash_use(const char *name){
+  for(size_t i = 0; i < sizeof(implementations) / sizeof(*implementations); i++){
+    if(strcmp(implementations[i].name, name) == 0 && supported(&implementations[i])){
+      current = &implementations[i];
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// the 128 bit product of a and b with its halves folded together
+static uint64_t mul_fold(uint64_t a, uint64_t b){
+  __uint128_t product = (__uint128_t) a * b;
+  return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+uint64_t hash64(const void *data, size_t len, uint64_t seed){
+  uint64_t acc[8] = {
+    0x00000000c2b2ae3dull, 0x9e3779b185ebca87ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull,
+    0x85ebca77c2b2ae63ull, 0x0000000085ebca77ull, 0x27d4eb2f165667c5ull, 0x000000009e3779b1ull,
+  };
+  for(int i = 0; i < 8; i++){
+    acc[i] += i & 1 ? -seed : seed;
+  }
+  const uint8_t *bytes = (const uint8_t *) data;
+  size_t stripes = len / STRIPE;
+  current->stripes(acc, bytes, 0, stripes);
+  // the rest is zero padded, the length below keeps that apart from zeros
+  if(len % STRIPE){
+    uint8_t last[STRIPE] = {0};
+    memcpy(last, bytes + stripes * STRIPE, len % STRIPE);
+    current->stripes(acc, last, stripes, stripes + 1);
+  }
+
+  uint64_t h = len * PRIME64_1;
+  for(int i = 0; i < 8; i += 2){
+    h += mul_fold(acc[i] ^ key[i + 1], acc[i + 1] ^ key[i + 2]);
+  }
+  h ^= h >> 37;
+  h *= 0x165667919e3779f9ull;
+  return h ^ (h >> 32);
+}
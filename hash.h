@@ -0,0 +1,40 @@
+#ifndef __HASH__
+#define __HASH__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "machine.h"
+
+/*
+ * 64 bit hash for comparing memory, after XXH3's loop for long inputs:
+ * eight 64 bit lanes each take a 32x32 bit multiply of the data mixed
+ * with a key plus the data of the neighbouring lane, 64 bytes a stripe,
+ * and are scrambled every 16 stripes. Lanes are independent, so SSE2 and
+ * AVX2 do two or four at a time and give the same value as the scalar
+ * loop. Not XXH3 bit for bit and not for anything adversarial
+ */
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+// the invaders video RAM of a 64 KiB address space
+static inline uint64_t hash_vram(const uint8_t *memory){
+  return hash64(memory + INVADERS_VRAM, INVADERS_VRAM_SIZE, 0);
+}
+
+// the whole address space, not the guard behind it
+static inline uint64_t hash_ram(const uint8_t *memory){
+  return hash64(memory, MEMORY_SIZE, 0);
+}
+
+/*
+ * the loop in use, "avx2", "sse2" or "scalar". The widest the CPU has is
+ * picked at startup
+ */
+const char *hash_implementation(void);
+
+/*
+ * switch to a loop by name, before any threads hash. Returns 0 or -1 if
+ * it is unknown or the CPU lacks it
+ */
+int hash_use(const char *name);
+
+#endif
@@ -0,0 +1,233 @@
+#include <string.h>
+#include "idiom.h"
+#include "opcodes.h"
+
+int idiom_enabled = 1;
+
+IdiomStats idiom_stats;
+
+// INX and the LDAX/STAX of each pointer pair, 0 where there is none
+static const uint8_t inx_ops[3] = {0x03, 0x13, 0x23};
+static const uint8_t load_ops[3] = {0x0a, 0x1a, 0x7e};
+static const uint8_t store_ops[3] = {0x02, 0x12, 0x77};
+
+/*
+ * the register a 3 bit field names, NULL for M
+ */
+static uint8_t *reg(State8080 *state, uint8_t field){
+  switch(field){
+    case 0: return &state->b;
+    case 1: return &state->c;
+    case 2: return &state->d;
+    case 3: return &state->e;
+    case 4: return &state->h;
+    case 5: return &state->l;
+    case 7: return &state->a;
+  }
+  return NULL;
+}
+
+static uint16_t *pair(State8080 *state, uint8_t code){
+  return code == IDIOM_BC ? &state->bc : code == IDIOM_DE ? &state->de : &state->hl;
+}
+
+static int find(const uint8_t *ops, uint8_t op){
+  for(int i = 0; i < 3; i++){
+    if(ops[i] == op){
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * DCR r counting a register that is neither in the pairs nor the value
+ */
+static int counter_of(uint8_t op, int used){
+  if((op & 0xc7) != 0x05 || ((op >> 3) & 7) == 6){
+    return -1;
+  }
+  int field = (op >> 3) & 7;
+  return (used >> field) & 1 ? -1 : field;
+}
+
+/*
+ * MVI M,n or MOV M,r storing a register the loop does not change, the
+ * bits of used are the register fields the loop writes
+ */
+static int fill_value(const uint8_t *memory, uint16_t pc, int used, Idiom *idiom){
+  uint8_t op = memory[pc];
+  if(op == 0x36){
+    idiom->value = 6;
+    idiom->immediate = memory[pc + 1];
+    return 2;
+  }
+  if(op >= 0x70 && op <= 0x77 && op != 0x76 && !((used >> (op & 7)) & 1)){
+    idiom->value = op & 7;
+    return 1;
+  }
+  return 0;
+}
+
+int idiom_match(const uint8_t *memory, uint16_t pc, Idiom *idiom){
+  // the loop body, up to the JNZ back to pc
+  uint8_t ops[8];
+  int n = 0;
+  int cycles = 0;
+  uint32_t adr = pc;
+  while(n < 8 && memory[adr] != 0xc2){
+    ops[n++] = memory[adr];
+    cycles += opcode_cycles[memory[adr]];
+    adr += opcode_lengths[memory[adr]];
+    if(adr > 0xfffd){
+      return IDIOM_NONE;
+    }
+  }
+  if(n == 8 || make_word(memory[adr + 2], memory[adr + 1]) != pc){
+    return IDIOM_NONE;
+  }
+  memset(idiom, 0, sizeof(*idiom));
+  idiom->start = pc;
+  idiom->end = adr + 3;
+  idiom->cycles = cycles + opcode_cycles[0xc2];
+  idiom->instructions = n + 1;
+
+  // H and L are the fill pointer, A is loaded or compared
+  int used = 1 << 4 | 1 << 5;
+  int len = fill_value(memory, pc, used | (n == 4 ? 1 << 7 : 0), idiom);
+  if(n == 3 && len && ((ops[1] == 0x23 && counter_of(ops[2], used) >= 0) || (ops[2] == 0x23 && counter_of(ops[1], used) >= 0))){
+    int counter = counter_of(ops[1] == 0x23 ? ops[2] : ops[1], used);
+    if(counter != idiom->value){
+      idiom->kind = IDIOM_FILL;
+      idiom->counter = counter;
+    }
+  }
+  if(n == 4 && len && ops[1] == 0x23 && ops[2] == 0x7c && ops[3] == 0xfe){
+    idiom->kind = IDIOM_FILL_UNTIL;
+    idiom->limit = memory[pc + len + 3];
+  }
+  if(n == 5){
+    int src = find(load_ops, ops[0]);
+    int dst = find(store_ops, ops[1]);
+    int incs = src >= 0 && dst >= 0 && src != dst &&
+      ((ops[2] == inx_ops[src] && ops[3] == inx_ops[dst]) || (ops[2] == inx_ops[dst] && ops[3] == inx_ops[src]));
+    if(incs){
+      // both pairs, and A which carries the byte
+      used = 3 << (src * 2) | 3 << (dst * 2) | 1 << 7;
+      int counter = counter_of(ops[4], used);
+      if(counter >= 0){
+        idiom->kind = IDIOM_COPY;
+        idiom->src = src;
+        idiom->dst = dst;
+        idiom->counter = counter;
+      }
+    }
+  }
+  return idiom->kind;
+}
+
+/*
+ * store len bytes from adr on, wrapping at the top of memory
+ */
+static void bulk_fill(uint8_t *memory, uint16_t adr, uint32_t len, uint8_t val){
+  uint32_t first = len < MEMORY_SIZE - adr ? len : MEMORY_SIZE - adr;
+  memset(memory + adr, val, first);
+  memset(memory, val, len - first);
+  if(len > first || adr < MEMORY_GUARD){
+    memory_sync_guard(memory);
+  }
+}
+
+/*
+ * copy forwards a byte at a time as the loop does, in one memmove when
+ * nothing wraps and the destination does not run into bytes still to
+ * read. Returns the last byte read, which the loop leaves in A
+ */
+static uint8_t bulk_copy(uint8_t *memory, uint16_t src, uint16_t dst, uint32_t len){
+  uint8_t last = 0;
+  if(src + len <= MEMORY_SIZE && dst + len <= MEMORY_SIZE && (dst <= src || dst >= src + len)){
+    last = memory[src + len - 1];
+    memmove(memory + dst, memory + src, len);
+    if(dst < MEMORY_GUARD){
+      memory_sync_guard(memory);
+    }
+    return last;
+  }
+  for(uint32_t i = 0; i < len; i++){
+    last = memory[(uint16_t) (src + i)];
+    memory_write(memory, dst + i, last);
+  }
+  return last;
+}
+
+/*
+ * whether len stores from adr on all land, the write window is aligned so
+ * a run that starts in it and fits in what is left of it does
+ */
+static int writable_run(const State8080 *state, uint16_t adr, uint32_t len){
+  if(state->write_mask == 0){
+    return 1;
+  }
+  uint32_t size = (uint16_t) ~state->write_mask + 1u;
+  return memory_writable(state, adr) && (uint16_t) (adr - state->write_base) + len <= size;
+}
+
+/*
+ * whether len stores from adr on reach the loop's own code
+ */
+static int overwrites_loop(const Idiom *idiom, uint16_t adr, uint32_t len){
+  uint16_t offset = idiom->start - adr;
+  return offset < len || (uint16_t) (adr - idiom->start) < idiom->end - idiom->start;
+}
+
+uint32_t idiom_run(const Idiom *idiom, State8080 *state, int budget, uint16_t *written){
+  uint32_t passes;
+  if(idiom->kind == IDIOM_FILL_UNTIL){
+    // passes until INX H leaves H at the limit
+    uint16_t target = idiom->limit << 8;
+    passes = (uint16_t) (state->hl + 1) >> 8 == idiom->limit ? 1 : (uint16_t) (target - state->hl);
+  }
+  else {
+    passes = *reg(state, idiom->counter);
+    passes = passes ? passes : 256;
+  }
+  uint32_t affordable = budget > 0 ? (budget + idiom->cycles - 1) / idiom->cycles : 1;
+  if(passes > affordable){
+    passes = affordable;
+  }
+
+  uint16_t from = idiom->kind == IDIOM_COPY ? *pair(state, idiom->dst) : state->hl;
+  if(overwrites_loop(idiom, from, passes) || !writable_run(state, from, passes)){
+    idiom_stats.declined++;
+    return 0;
+  }
+  idiom_stats.runs++;
+  idiom_stats.passes += passes;
+  *written = from;
+
+  if(idiom->kind == IDIOM_COPY){
+    uint16_t *src = pair(state, idiom->src);
+    uint16_t *dst = pair(state, idiom->dst);
+    state->a = bulk_copy(state->memory, *src, *dst, passes);
+    *src += passes;
+    *dst += passes;
+  }
+  else {
+    uint8_t val = idiom->value == 6 ? idiom->immediate : *reg(state, idiom->value);
+    bulk_fill(state->memory, state->hl, passes, val);
+    state->hl += passes;
+  }
+
+  // the flags are those of the last pass's DCR or CPI
+  if(idiom->kind == IDIOM_FILL_UNTIL){
+    state->a = state->h;
+    cmp(state, idiom->limit);
+  }
+  else {
+    uint8_t *counter = reg(state, idiom->counter);
+    *counter -= passes - 1;
+    dcr(state, counter);
+  }
+  state->pc = state->cc.z ? idiom->end : idiom->start;
+  return passes;
+}
@@ -0,0 +1,74 @@
+#ifndef __IDIOM__
+#define __IDIOM__
+
+#include <stdint.h>
+#include "emulator.h"
+
+/*
+ * loops the fast tiers run as one bulk memory operation, all of them a
+ * single block ending in JNZ back to its own start:
+ *
+ *   IDIOM_FILL        MVI M,n | MOV M,r; INX H; DCR c              (any order of the last two)
+ *   IDIOM_COPY        LDAX src | MOV A,M; STAX dst | MOV M,A; INX src; INX dst; DCR c
+ *   IDIOM_FILL_UNTIL  MVI M,n | MOV M,r; INX H; MOV A,H; CPI limit
+ */
+enum {
+  IDIOM_NONE,
+  IDIOM_FILL,
+  IDIOM_COPY,
+  IDIOM_FILL_UNTIL
+};
+
+// register pairs as encoded in LXI/INX/LDAX
+#define IDIOM_BC 0
+#define IDIOM_DE 1
+#define IDIOM_HL 2
+
+typedef struct Idiom {
+  uint8_t kind;
+  uint16_t start;
+  // first address after the closing JNZ
+  uint16_t end;
+  // cycles and instructions of one pass, JNZ included
+  int cycles;
+  int instructions;
+  // 3 bit register field counted down by DCR
+  uint8_t counter;
+  // register field of the stored byte, 6 for the immediate of MVI M
+  uint8_t value;
+  uint8_t immediate;
+  // IDIOM_COPY pointer pairs
+  uint8_t src;
+  uint8_t dst;
+  // IDIOM_FILL_UNTIL value of H that ends the loop
+  uint8_t limit;
+} Idiom;
+
+// cleared to run every loop instruction by instruction, for comparisons
+extern int idiom_enabled;
+
+// process wide counts of idiom_run() calls
+typedef struct IdiomStats {
+  uint64_t runs;
+  uint64_t passes;
+  uint64_t declined;
+} IdiomStats;
+
+extern IdiomStats idiom_stats;
+
+/*
+ * recognize one of the loops at pc, fills in idiom and returns its kind
+ */
+int idiom_match(const uint8_t *memory, uint16_t pc, Idiom *idiom);
+
+/*
+ * Run passes of the loop at state->pc: all of them, or fewer once budget
+ * cycles are spent, ending on a pass boundary with the registers, flags
+ * and pc stepping would leave. Returns the passes run, 0 when it declines
+ * (the loop would write over itself or store outside the write window)
+ * and the caller has to step it. *written is where the stores began,
+ * they cover as many bytes as passes
+ */
+uint32_t idiom_run(const Idiom *idiom, State8080 *state, int budget, uint16_t *written);
+
+#endif
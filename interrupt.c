@@ -0,0 +1,44 @@
+#include <string.h>
+#include "interrupt.h"
+
+void interrupt_init(Interrupts *irq){
+  memset(irq, 0, sizeof(*irq));
+}
+
+void interrupt_request(Interrupts *irq, int rst){
+  if(irq->pending){
+    irq->replaced++;
+  }
+  irq->pending = 1;
+  irq->rst = rst & 7;
+  irq->requested++;
+}
+
+int interrupt_delay_step(Interrupts *irq, State8080 *state){
+  if(!irq->pending || !state->int_enable || !state->int_delay){
+    return 0;
+  }
+  irq->delayed++;
+  return emulate(state);
+}
+
+int interrupt_service(Interrupts *irq, State8080 *state){
+  if(!irq->pending || !state->int_enable){
+    return 0;
+  }
+  int cycles = 0;
+  // EI enables interrupts only once the next instruction has run, which
+  // may be another EI or a DI
+  int spent;
+  while((spent = interrupt_delay_step(irq, state))){
+    cycles += spent;
+  }
+  if(!state->int_enable){
+    return cycles;
+  }
+  state->int_enable = 0;
+  call_adr(state, irq->rst << 3);
+  irq->pending = 0;
+  irq->taken++;
+  return cycles + INTERRUPT_CYCLES;
+}
@@ -0,0 +1,54 @@
+#ifndef __INTERRUPT__
+#define __INTERRUPT__
+
+#include <stdint.h>
+#include "emulator.h"
+
+// cycles the CPU takes to accept an interrupt, those of the RST it runs
+#define INTERRUPT_CYCLES 11
+
+/*
+ * The interrupt line of one 8080. A device requests an RST and the request
+ * is held until the CPU accepts it, at an instruction boundary with
+ * interrupts enabled that does not directly follow an EI. Accepting clears
+ * int_enable and runs the RST the device puts on the bus, pushing pc with
+ * call_adr(). A newer request replaces one still waiting.
+ *
+ * The cores only stop where their caller asks them to, or right after an EI
+ * (state->int_delay), so calling interrupt_service() between runs while a
+ * request is pending delivers it at the first boundary the CPU could take
+ * it. Nothing is checked per instruction
+ */
+typedef struct Interrupts {
+  // a request is waiting for the CPU
+  uint8_t pending;
+  // the RST number it asks for, 0 - 7
+  uint8_t rst;
+  uint64_t requested;
+  uint64_t taken;
+  // requests replaced before the CPU took them
+  uint64_t replaced;
+  // instructions run after an EI before taking a request
+  uint64_t delayed;
+} Interrupts;
+
+void interrupt_init(Interrupts *irq);
+
+void interrupt_request(Interrupts *irq, int rst);
+
+/*
+ * run one instruction held back by an EI when a request waits for it,
+ * returns its cycles, 0 when there is none. A caller with devices steps
+ * through these before interrupt_service() to pass on an OUT among them
+ * before the interrupt routine can write over it
+ */
+int interrupt_delay_step(Interrupts *irq, State8080 *state);
+
+/*
+ * deliver the pending request if the CPU accepts it now: the instruction
+ * after an EI is run first, then the RST if that left interrupts enabled.
+ * Returns the cycles spent, 0 when nothing was delivered
+ */
+int interrupt_service(Interrupts *irq, State8080 *state);
+
+#endif
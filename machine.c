@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "machine.h"
+
+#define HUGE_PAGE (1 << 21)
+
+/*
+ * a machine and its memory in one slot, both on their own cache lines
+ */
+typedef struct MachineSlot {
+  Machine machine __attribute__((aligned(64)));
+  uint8_t memory[MEMORY_ALLOC] __attribute__((aligned(64)));
+} MachineSlot;
+
+#define SLOTS_PER_SLAB (MACHINE_SLAB / sizeof(MachineSlot))
+
+/*
+ * map a huge page aligned slab, from the huge page pool if the kernel has
+ * one reserved and otherwise as normal pages it may back transparently
+ */
+static void *map_slab(int *huge){
+#ifdef MAP_HUGETLB
+  void *pages = mmap(NULL, MACHINE_SLAB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if(pages != MAP_FAILED){
+    *huge = 1;
+    return pages;
+  }
+#endif
+  *huge = 0;
+  uint8_t *raw = (uint8_t *) mmap(NULL, MACHINE_SLAB + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(raw == MAP_FAILED){
+    return NULL;
+  }
+  // trim the mapping down to an aligned slab
+  uint8_t *slab = (uint8_t *) (((uintptr_t) raw + HUGE_PAGE - 1) & ~(uintptr_t) (HUGE_PAGE - 1));
+  if(slab > raw){
+    munmap(raw, slab - raw);
+  }
+  munmap(slab + MACHINE_SLAB, raw + HUGE_PAGE - slab);
+#ifdef MADV_HUGEPAGE
+  madvise(slab, MACHINE_SLAB, MADV_HUGEPAGE);
+#endif
+  return slab;
+}
+
+/*
+ * add a slab of free machines, each with the image already in place
+ */
+static void grow(MachinePool *pool){
+  int huge;
+  MachineSlot *slots = (MachineSlot *) map_slab(&huge);
+  if(slots == NULL){
+    fprintf(stderr, "could not map a %d byte machine slab\n", MACHINE_SLAB);
+    exit(1);
+  }
+  pool->slabs = (void **) realloc(pool->slabs, (pool->slab_count + 1) * sizeof(*pool->slabs));
+  pool->slabs[pool->slab_count++] = slots;
+  pool->huge_slabs += huge;
+  for(int i = SLOTS_PER_SLAB - 1; i >= 0; i--){
+    Machine *machine = &slots[i].machine;
+    machine->state.memory = slots[i].memory;
+    memcpy(machine->state.memory, pool->image, MEMORY_ALLOC);
+    machine->pool = pool;
+    machine->next_free = pool->free_list;
+    pool->free_list = machine;
+  }
+  pool->allocated += SLOTS_PER_SLAB;
+}
+
+static Machine *take(MachinePool *pool){
+  if(pool->free_list == NULL){
+    grow(pool);
+  }
+  Machine *machine = pool->free_list;
+  pool->free_list = machine->next_free;
+  machine->next_free = NULL;
+  pool->live++;
+  return machine;
+}
+
+/*
+ * a pool for machines booting image, a full 64 KiB memory image whose
+ * bottom rom_size bytes are ROM, with room for reserve machines up front.
+ * rom_size is a multiple of INVADERS_RAM_SIZE, so write_mask can tell
+ * the RAM right above it
+ */
+MachinePool *machine_pool_create(const uint8_t *image, uint16_t rom_size, int reserve){
+  MachinePool *pool = (MachinePool *) calloc(1, sizeof(MachinePool));
+  pool->image = (uint8_t *) malloc(MEMORY_ALLOC);
+  memcpy(pool->image, image, MEMORY_SIZE);
+  memory_sync_guard(pool->image);
+  pool->rom_size = rom_size;
+  while(pool->allocated < reserve){
+    grow(pool);
+  }
+  return pool;
+}
+
+void machine_pool_free(MachinePool *pool){
+  for(int i = 0; i < pool->slab_count; i++){
+    munmap(pool->slabs[i], MACHINE_SLAB);
+  }
+  free(pool->slabs);
+  free(pool->image);
+  free(pool);
+}
+
+static Machine *machine_of(Scheduler *sched){
+  return (Machine *) ((uint8_t *) sched - offsetof(Machine, sched));
+}
+
+/*
+ * the video hardware requests RST 1 when the beam is halfway down the
+ * screen and RST 2 at its end. The machine is found from its scheduler
+ * rather than a ctx, so a clone's copy of the event is its own
+ */
+static void video_interrupt(Scheduler *sched, State8080 *state, uint64_t when, void *ctx){
+  Machine *machine = machine_of(sched);
+  interrupt_request(&machine->irq, machine->video_half ? 2 : 1);
+  machine->video_half = !machine->video_half;
+  sched_at(sched, when + INVADERS_FRAME_CYCLES / 2, video_interrupt, NULL);
+}
+
+static void port_write(Scheduler *sched, uint8_t port, uint8_t value, void *ctx){
+  Machine *machine = machine_of(sched);
+  uint8_t previous = machine->ports[port & 7];
+  machine->ports[port & 7] = value;
+  if(machine->listener){
+    machine->listener(machine, port, previous, value, machine->listener_ctx);
+  }
+}
+
+/*
+ * the only memory a machine changes, the rest is as the slot was stamped
+ */
+static void copy_ram(uint8_t *memory, const uint8_t *from, uint16_t rom_size){
+  memcpy(memory + rom_size, from + rom_size, INVADERS_RAM_SIZE);
+  memcpy(memory + MEMORY_SIZE, from + MEMORY_SIZE, MEMORY_GUARD);
+}
+
+/*
+ * a machine at reset: registers cleared, memory from the image
+ */
+Machine *machine_create(MachinePool *pool){
+  Machine *machine = take(pool);
+  uint8_t *memory = machine->state.memory;
+  memset(&machine->state, 0, sizeof(machine->state));
+  machine->state.memory = memory;
+  machine->state.write_mask = (uint16_t) ~(INVADERS_RAM_SIZE - 1);
+  machine->state.write_base = pool->rom_size;
+  machine->instructions = 0;
+  machine->cycles = 0;
+  interrupt_init(&machine->irq);
+  sched_init(&machine->sched, &machine->irq);
+  sched_output(&machine->sched, port_write, NULL);
+  sched_at(&machine->sched, INVADERS_FRAME_CYCLES / 2, video_interrupt, NULL);
+  machine->video_half = 0;
+  memset(machine->ports, 0, sizeof(machine->ports));
+  machine->listener = NULL;
+  machine->listener_ctx = NULL;
+  copy_ram(memory, pool->image, pool->rom_size);
+  return machine;
+}
+
+/*
+ * a machine that continues from where parent is, independently of it
+ */
+Machine *machine_clone(const Machine *parent){
+  MachinePool *pool = parent->pool;
+  Machine *machine = take(pool);
+  uint8_t *memory = machine->state.memory;
+  machine->state = parent->state;
+  machine->state.memory = memory;
+  machine->instructions = parent->instructions;
+  machine->cycles = parent->cycles;
+  machine->irq = parent->irq;
+  machine->sched = parent->sched;
+  machine->sched.irq = &machine->irq;
+  machine->video_half = parent->video_half;
+  memcpy(machine->ports, parent->ports, sizeof(machine->ports));
+  machine->listener = NULL;
+  machine->listener_ctx = NULL;
+  copy_ram(memory, parent->state.memory, pool->rom_size);
+  return machine;
+}
+
+/*
+ * hand a machine back to its pool
+ */
+void machine_release(Machine *machine){
+  MachinePool *pool = machine->pool;
+  machine->next_free = pool->free_list;
+  pool->free_list = machine;
+  pool->live--;
+}
+
+uint64_t machine_run(Machine *machine, BatchCore core, uint64_t until){
+  uint64_t cycles = sched_run(&machine->sched, &machine->state, core, until);
+  machine->cycles += cycles;
+  return cycles;
+}
+
+void machine_listen(Machine *machine, PortListener listener, void *ctx){
+  machine->listener = listener;
+  machine->listener_ctx = ctx;
+}
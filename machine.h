@@ -0,0 +1,110 @@
+#ifndef __MACHINE__
+#define __MACHINE__
+
+#include <stdint.h>
+#include "emulator.h"
+#include "interrupt.h"
+#include "sched.h"
+
+// the invaders ROM fills the bottom 8 KiB and its 8 KiB of RAM follow, the
+// board drops writes anywhere else
+#define INVADERS_ROM_SIZE 0x2000
+#define INVADERS_RAM_SIZE 0x2000
+// the board runs the 8080 at 2 MHz and refreshes the screen at 60 Hz
+#define INVADERS_CLOCK_HZ 2000000
+#define INVADERS_FRAME_CYCLES (INVADERS_CLOCK_HZ / 60)
+// video RAM is 224 lines of 256 one bit pixels, least significant bit
+// first. The monitor is turned a quarter turn, so the picture is 224 wide
+// and 256 tall with the lines running bottom to top
+#define INVADERS_VRAM 0x2400
+#define INVADERS_VRAM_SIZE 0x1c00
+#define INVADERS_SCREEN_WIDTH 224
+#define INVADERS_SCREEN_HEIGHT 256
+// machines are carved out of slabs of this many bytes, a multiple of the
+// 2 MiB huge page size
+#define MACHINE_SLAB (1 << 23)
+
+struct Machine;
+
+/*
+ * told about each byte the CPU writes to an output port along with what
+ * the latch held before, machine->sched.now is the cycle after the OUT
+ */
+typedef void (*PortListener)(struct Machine *machine, uint8_t port, uint8_t previous, uint8_t value, void *ctx);
+
+/*
+ * one emulated board: the CPU with its 64 KiB address space and the
+ * devices around it, everything a clone has to copy to continue
+ * independently of its parent. The pool places the memory right behind
+ * the struct, in the same slot
+ */
+typedef struct Machine {
+  State8080 state;
+  uint64_t instructions;
+  uint64_t cycles;
+  // pending interrupts and the timeline holding the next video interrupt,
+  // which asks for RST 2 after video_half is set and RST 1 otherwise
+  Interrupts irq;
+  Scheduler sched;
+  uint8_t video_half;
+  // the output latches, the board decodes the low three port bits
+  uint8_t ports[8];
+  // the host's, a clone starts without one
+  PortListener listener;
+  void *listener_ctx;
+  struct MachinePool *pool;
+  struct Machine *next_free;
+} Machine;
+
+/*
+ * recycles machines and their memory so creating and cloning them does not
+ * go through malloc, create and release are a free list pop and push.
+ * Slabs are backed by huge pages when the kernel has them, so thousands of
+ * machines need few TLB entries. Every slot is stamped with the whole
+ * image when its slab is allocated. A machine's stores only land in the
+ * INVADERS_RAM_SIZE bytes of RAM above rom_size (see write_mask in
+ * emulator.h), so the ROM and the rest of the image stay as stamped and
+ * are shared by the whole pool; create and clone copy only the RAM and
+ * the guard.
+ */
+typedef struct MachinePool {
+  uint8_t *image;
+  uint16_t rom_size;
+  Machine *free_list;
+  void **slabs;
+  int slab_count;
+  int huge_slabs;
+  int allocated;
+  int live;
+} MachinePool;
+
+MachinePool *machine_pool_create(const uint8_t *image, uint16_t rom_size, int reserve);
+
+void machine_pool_free(MachinePool *pool);
+
+/*
+ * a machine at reset, its first video interrupt due halfway down the
+ * first frame
+ */
+Machine *machine_create(MachinePool *pool);
+
+/*
+ * a machine that continues from where parent is, pending interrupts,
+ * scheduled events and latches included. Events the host added keep the
+ * ctx they were given
+ */
+Machine *machine_clone(const Machine *parent);
+
+/*
+ * run core through the scheduler up to cycle until, returns the cycles
+ */
+uint64_t machine_run(Machine *machine, BatchCore core, uint64_t until);
+
+/*
+ * pass port writes to listener, NULL to stop
+ */
+void machine_listen(Machine *machine, PortListener listener, void *ctx);
+
+void machine_release(Machine *machine);
+
+#endif
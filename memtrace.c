@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "memtrace.h"
+
+uint64_t memtrace_reads[1 << 16];
+uint64_t memtrace_writes[1 << 16];
+uint64_t memtrace_executes[1 << 16];
+
+void memtrace_reset(void){
+  memset(memtrace_reads, 0, sizeof(memtrace_reads));
+  memset(memtrace_writes, 0, sizeof(memtrace_writes));
+  memset(memtrace_executes, 0, sizeof(memtrace_executes));
+}
+
+/*
+ * write reads, writes and executes summed over lines of line_size bytes
+ * (a power of two, 1 for per address), lines never touched are skipped
+ */
+int memtrace_write_csv(const char *path, int line_size){
+  FILE *f = fopen(path, "w");
+  if(f == NULL){
+    return -1;
+  }
+  fprintf(f, "address,reads,writes,executes\n");
+  for(int line = 0; line < (1 << 16); line += line_size){
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t executes = 0;
+    for(int adr = line; adr < line + line_size && adr < (1 << 16); adr++){
+      reads += memtrace_reads[adr];
+      writes += memtrace_writes[adr];
+      executes += memtrace_executes[adr];
+    }
+    if(reads || writes || executes){
+      fprintf(f, "0x%04x,%llu,%llu,%llu\n", line, (unsigned long long) reads,
+              (unsigned long long) writes, (unsigned long long) executes);
+    }
+  }
+  return fclose(f);
+}
+
+static uint64_t max_count(const uint64_t *counts){
+  uint64_t max = 0;
+  for(int i = 0; i < (1 << 16); i++){
+    if(counts[i] > max){
+      max = counts[i];
+    }
+  }
+  return max;
+}
+
+/*
+ * scale a count logarithmically into 0..255 relative to the channel maximum
+ */
+static uint8_t intensity(uint64_t count, uint64_t max){
+  if(count == 0){
+    return 0;
+  }
+  return 32 + (uint8_t) (223.0 * log((double) count) / log((double) max + 1));
+}
+
+/*
+ * write a 256x256 binary PPM, one pixel per address with rows of 256 bytes,
+ * red for writes, green for reads and blue for executes
+ */
+int memtrace_write_ppm(const char *path){
+  FILE *f = fopen(path, "wb");
+  if(f == NULL){
+    return -1;
+  }
+  uint64_t max_reads = max_count(memtrace_reads);
+  uint64_t max_writes = max_count(memtrace_writes);
+  uint64_t max_executes = max_count(memtrace_executes);
+
+  fprintf(f, "P6\n256 256\n255\n");
+  for(int adr = 0; adr < (1 << 16); adr++){
+    uint8_t pixel[3];
+    pixel[0] = intensity(memtrace_writes[adr], max_writes);
+    pixel[1] = intensity(memtrace_reads[adr], max_reads);
+    pixel[2] = intensity(memtrace_executes[adr], max_executes);
+    fwrite(pixel, sizeof(pixel), 1, f);
+  }
+  return fclose(f);
+}
@@ -0,0 +1,35 @@
+#ifndef __MEMTRACE__
+#define __MEMTRACE__
+
+#include <stdint.h>
+#include "emulator.h"
+
+/*
+ * access counters per emulated address, only compiled in with -DMEMTRACE
+ */
+extern uint64_t memtrace_reads[1 << 16];
+extern uint64_t memtrace_writes[1 << 16];
+extern uint64_t memtrace_executes[1 << 16];
+
+static inline uint8_t memtrace_read(uint8_t *memory, int adr){
+  memtrace_reads[(uint16_t) adr]++;
+  return memory[adr];
+}
+
+static inline void memtrace_write(uint8_t *memory, int adr, uint8_t val){
+  memtrace_writes[(uint16_t) adr]++;
+  memory_write(memory, adr, val);
+}
+
+static inline uint8_t memtrace_fetch(uint8_t *memory, int adr){
+  memtrace_executes[(uint16_t) adr]++;
+  return memory[adr];
+}
+
+void memtrace_reset(void);
+
+int memtrace_write_csv(const char *path, int line_size);
+
+int memtrace_write_ppm(const char *path);
+
+#endif
@@ -0,0 +1,106 @@
+#include "opcodes.h"
+
+const char *opcode_names[256] = {
+  "NOP", "LXI B,d16", "STAX B", "INX B",
+  "INR B", "DCR B", "MVI B,d8", "RLC",
+  "*NOP", "DAD B", "LDAX B", "DCX B",
+  "INR C", "DCR C", "MVI C,d8", "RRC",
+  "*NOP", "LXI D,d16", "STAX D", "INX D",
+  "INR D", "DCR D", "MVI D,d8", "RAL",
+  "*NOP", "DAD D", "LDAX D", "DCX D",
+  "INR E", "DCR E", "MVI E,d8", "RAR",
+  "*NOP", "LXI H,d16", "SHLD adr", "INX H",
+  "INR H", "DCR H", "MVI H,d8", "DAA",
+  "*NOP", "DAD H", "LHLD adr", "DCX H",
+  "INR L", "DCR L", "MVI L,d8", "CMA",
+  "*NOP", "LXI SP,d16", "STA adr", "INX SP",
+  "INR M", "DCR M", "MVI M,d8", "STC",
+  "*NOP", "DAD SP", "LDA adr", "DCX SP",
+  "INR A", "DCR A", "MVI A,d8", "CMC",
+  "MOV B,B", "MOV B,C", "MOV B,D", "MOV B,E",
+  "MOV B,H", "MOV B,L", "MOV B,M", "MOV B,A",
+  "MOV C,B", "MOV C,C", "MOV C,D", "MOV C,E",
+  "MOV C,H", "MOV C,L", "MOV C,M", "MOV C,A",
+  "MOV D,B", "MOV D,C", "MOV D,D", "MOV D,E",
+  "MOV D,H", "MOV D,L", "MOV D,M", "MOV D,A",
+  "MOV E,B", "MOV E,C", "MOV E,D", "MOV E,E",
+  "MOV E,H", "MOV E,L", "MOV E,M", "MOV E,A",
+  "MOV H,B", "MOV H,C", "MOV H,D", "MOV H,E",
+  "MOV H,H", "MOV H,L", "MOV H,M", "MOV H,A",
+  "MOV L,B", "MOV L,C", "MOV L,D", "MOV L,E",
+  "MOV L,H", "MOV L,L", "MOV L,M", "MOV L,A",
+  "MOV M,B", "MOV M,C", "MOV M,D", "MOV M,E",
+  "MOV M,H", "MOV M,L", "HLT", "MOV M,A",
+  "MOV A,B", "MOV A,C", "MOV A,D", "MOV A,E",
+  "MOV A,H", "MOV A,L", "MOV A,M", "MOV A,A",
+  "ADD B", "ADD C", "ADD D", "ADD E",
+  "ADD H", "ADD L", "ADD M", "ADD A",
+  "ADC B", "ADC C", "ADC D", "ADC E",
+  "ADC H", "ADC L", "ADC M", "ADC A",
+  "SUB B", "SUB C", "SUB D", "SUB E",
+  "SUB H", "SUB L", "SUB M", "SUB A",
+  "SBB B", "SBB C", "SBB D", "SBB E",
+  "SBB H", "SBB L", "SBB M", "SBB A",
+  "ANA B", "ANA C", "ANA D", "ANA E",
+  "ANA H", "ANA L", "ANA M", "ANA A",
+  "XRA B", "XRA C", "XRA D", "XRA E",
+  "XRA H", "XRA L", "XRA M", "XRA A",
+  "ORA B", "ORA C", "ORA D", "ORA E",
+  "ORA H", "ORA L", "ORA M", "ORA A",
+  "CMP B", "CMP C", "CMP D", "CMP E",
+  "CMP H", "CMP L", "CMP M", "CMP A",
+  "RNZ", "POP B", "JNZ adr", "JMP adr",
+  "CNZ adr", "PUSH B", "ADI d8", "RST 0",
+  "RZ", "RET", "JZ adr", "*JMP adr",
+  "CZ adr", "CALL adr", "ACI d8", "RST 1",
+  "RNC", "POP D", "JNC adr", "OUT d8",
+  "CNC adr", "PUSH D", "SUI d8", "RST 2",
+  "RC", "*RET", "JC adr", "IN d8",
+  "CC adr", "*CALL adr", "SBI d8", "RST 3",
+  "RPO", "POP H", "JPO adr", "XTHL",
+  "CPO adr", "PUSH H", "ANI d8", "RST 4",
+  "RPE", "PCHL", "JPE adr", "XCHG",
+  "CPE adr", "*CALL adr", "XRI d8", "RST 5",
+  "RP", "POP PSW", "JP adr", "DI",
+  "CP adr", "PUSH PSW", "ORI d8", "RST 6",
+  "RM", "SPHL", "JM adr", "EI",
+  "CM adr", "*CALL adr", "CPI d8", "RST 7",
+};
+
+const uint8_t opcode_lengths[256] = {
+  1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, /* 0x00 */
+  1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, /* 0x10 */
+  1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, /* 0x20 */
+  1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, /* 0x30 */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x40 */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x50 */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x60 */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x70 */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x80 */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x90 */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0xa0 */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0xb0 */
+  1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 3, 3, 3, 2, 1, /* 0xc0 */
+  1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, /* 0xd0 */
+  1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1, /* 0xe0 */
+  1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1, /* 0xf0 */
+};
+
+const uint8_t opcode_cycles[256] = {
+   4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4, /* 0x00 */
+   4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4, /* 0x10 */
+   4, 10, 16,  5,  5,  5,  7,  4,  4, 10, 16,  5,  5,  5,  7,  4, /* 0x20 */
+   4, 10, 13,  5, 10, 10, 10,  4,  4, 10, 13,  5,  5,  5,  7,  4, /* 0x30 */
+   5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5, /* 0x40 */
+   5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5, /* 0x50 */
+   5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5, /* 0x60 */
+   7,  7,  7,  7,  7,  7,  7,  7,  5,  5,  5,  5,  5,  5,  7,  5, /* 0x70 */
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* 0x80 */
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* 0x90 */
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* 0xa0 */
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* 0xb0 */
+   5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10, 10, 11, 17,  7, 11, /* 0xc0 */
+   5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10, 10, 11, 17,  7, 11, /* 0xd0 */
+   5, 10, 10, 18, 11, 11,  7, 11,  5,  5, 10,  4, 11, 17,  7, 11, /* 0xe0 */
+   5, 10, 10,  4, 11, 11,  7, 11,  5,  5, 10,  4, 11, 17,  7, 11, /* 0xf0 */
+};
@@ -0,0 +1,47 @@
+#ifndef __OPCODES__
+#define __OPCODES__
+
+#include <stdint.h>
+
+/*
+ * mnemonic of each opcode, operands written as d8/d16/adr
+ */
+extern const char *opcode_names[256];
+
+/*
+ * length in bytes of each opcode including its operands
+ */
+extern const uint8_t opcode_lengths[256];
+
+/*
+ * 8080 clock cycles of each opcode, conditional calls and returns
+ * are listed with their not-taken cost
+ */
+extern const uint8_t opcode_cycles[256];
+
+/*
+ * extra cycles spent by a conditional call or return that is taken
+ */
+#define COND_TAKEN_CYCLES 6
+
+/*
+ * X-macro tables for the regular opcode blocks. REGISTERS lists the 3 bit
+ * register field in encoding order, 6 being the memory operand M.
+ * SOURCES is the same list with two leading arguments passed through, so
+ * one row of a block can be expanded from inside REGISTERS or ALU_OPS:
+ *
+ *   0x40 | dst << 3 | src   MOV dst,src  REGISTERS(row), row: SOURCES(X, code, dst)
+ *   0x80 | op << 3 | src    ALU A,src    ALU_OPS(row), row: SOURCES(X, code, op)
+ */
+#define REGISTERS(X) X(0, b) X(1, c) X(2, d) X(3, e) X(4, h) X(5, l) X(6, m) X(7, a)
+
+#define SOURCES(X, code, name) \
+  X(code, 0, name, b) X(code, 1, name, c) X(code, 2, name, d) X(code, 3, name, e) \
+  X(code, 4, name, h) X(code, 5, name, l) X(code, 6, name, m) X(code, 7, name, a)
+
+// the ALU operation field, named as the emulate() helper and the batch macro
+#define ALU_OPS(X) \
+  X(0, add, ADD) X(1, adc, ADC) X(2, sub, SUB) X(3, sbb, SBB) \
+  X(4, ana, ANA) X(5, xra, XRA) X(6, ora, ORA) X(7, cmp, CMP)
+
+#endif
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pace.h"
+
+int64_t pace_now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void pace_init(Pacer *pacer, double frame_hz, double speed){
+  memset(pacer, 0, sizeof(*pacer));
+  pacer->speed = speed;
+  pacer->period_ns = speed > 0 ? (int64_t) (1e9 / frame_hz / speed) : 0;
+  pacer->start_ns = pace_now();
+  pacer->begin_ns = pacer->start_ns;
+}
+
+void pace_free(Pacer *pacer){
+  free(pacer->jitter);
+  free(pacer->overrun);
+}
+
+/*
+ * a frame adds one sample to either array, so both grow with the frames
+ */
+static void reserve(Pacer *pacer){
+  if(pacer->frames > pacer->capacity){
+    pacer->capacity = pacer->capacity ? pacer->capacity * 2 : 1024;
+    pacer->jitter = (int64_t *) realloc(pacer->jitter, pacer->capacity * sizeof(int64_t));
+    pacer->overrun = (int64_t *) realloc(pacer->overrun, pacer->capacity * sizeof(int64_t));
+  }
+}
+
+static void sleep_until(int64_t ns){
+  struct timespec ts = {ns / 1000000000, ns % 1000000000};
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0){
+    // interrupted by a signal, sleep the rest
+  }
+}
+
+void pace_wait(Pacer *pacer){
+  pacer->frames++;
+  if(pacer->speed <= 0){
+    return;
+  }
+  reserve(pacer);
+  int64_t deadline = pacer->start_ns + pacer->frames * pacer->period_ns;
+  int64_t now = pace_now();
+  if(now > deadline){
+    pacer->overrun[pacer->overrun_count++] = now - deadline;
+    if(now - deadline > PACE_MAX_BEHIND * pacer->period_ns){
+      // too far behind to catch up, the next frame is due a period from now
+      pacer->start_ns = now - pacer->frames * pacer->period_ns;
+      pacer->resyncs++;
+    }
+    return;
+  }
+  if(deadline - now > PACE_SPIN_NS){
+    sleep_until(deadline - PACE_SPIN_NS);
+  }
+  while((now = pace_now()) < deadline){
+  }
+  pacer->jitter[pacer->jitter_count++] = now - deadline;
+}
+
+static int compare_ns(const void *a, const void *b){
+  int64_t x = *(const int64_t *) a;
+  int64_t y = *(const int64_t *) b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * p50, p90, p99 and the maximum of samples in microseconds, sorts them
+ */
+static void percentiles(FILE *f, const char *name, int64_t *samples, uint64_t count){
+  if(count == 0){
+    fprintf(f, "%-8s none\n", name);
+    return;
+  }
+  qsort(samples, count, sizeof(int64_t), compare_ns);
+  fprintf(f, "%-8s %8llu frames, p50 %9.2f us, p90 %9.2f us, p99 %9.2f us, max %9.2f us\n", name,
+          (unsigned long long) count, samples[count / 2] / 1e3, samples[count * 9 / 10] / 1e3,
+          samples[count * 99 / 100] / 1e3, samples[count - 1] / 1e3);
+}
+
+void pace_report(Pacer *pacer, FILE *f, uint64_t cycles){
+  double seconds = (pace_now() - pacer->begin_ns) / 1e9;
+  if(pacer->speed > 0){
+    fprintf(f, "%llu frames at %.2fx real time\n", (unsigned long long) pacer->frames, pacer->speed);
+  }
+  else {
+    fprintf(f, "%llu frames unthrottled\n", (unsigned long long) pacer->frames);
+  }
+  fprintf(f, "%.3f s wall clock, %.3f emulated MHz\n", seconds, cycles / seconds / 1e6);
+  if(pacer->speed > 0){
+    percentiles(f, "jitter", pacer->jitter, pacer->jitter_count);
+    percentiles(f, "overrun", pacer->overrun, pacer->overrun_count);
+    fprintf(f, "resyncs  %llu\n", (unsigned long long) pacer->resyncs);
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef __PACE__
+#define __PACE__
+
+#include <stdio.h>
+#include <stdint.h>
+
+// the last stretch before a deadline is spun out rather than slept, the
+// kernel wakes sleepers up to a scheduler tick late
+#define PACE_SPIN_NS 200000
+// this many frames behind the host gives up catching up and starts over
+#define PACE_MAX_BEHIND 4
+
+/*
+ * Holds emulated frames to wall clock time: every frame has an absolute
+ * deadline on CLOCK_MONOTONIC, start + (n + 1) * period / speed, so the
+ * error of one wait never carries into the next. pace_wait() sleeps with
+ * clock_nanosleep(TIMER_ABSTIME) until PACE_SPIN_NS before the deadline
+ * and spins the rest. A frame whose emulation ran past its deadline is an
+ * overrun, later frames skip their waits to catch up. Speed 0 is turbo,
+ * no waiting at all
+ */
+typedef struct Pacer {
+  double speed;
+  int64_t period_ns;
+  // when frame 0 was due, moved up by a resync
+  int64_t start_ns;
+  int64_t begin_ns;
+  uint64_t frames;
+  // per frame, wake up time minus deadline for the frames that waited and
+  // finish time minus deadline for the overruns, in ns
+  int64_t *jitter;
+  uint64_t jitter_count;
+  int64_t *overrun;
+  uint64_t overrun_count;
+  uint64_t capacity;
+  uint64_t resyncs;
+} Pacer;
+
+int64_t pace_now(void);
+
+/*
+ * start pacing frames of frame_hz at speed times real time
+ */
+void pace_init(Pacer *pacer, double frame_hz, double speed);
+
+void pace_free(Pacer *pacer);
+
+/*
+ * call after emulating each frame, returns once its deadline has come
+ */
+void pace_wait(Pacer *pacer);
+
+/*
+ * wall clock time, effective speed, jitter and overrun percentiles
+ */
+void pace_report(Pacer *pacer, FILE *f, uint64_t cycles);
+
+#endif
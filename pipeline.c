@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+#include "hash.h"
+
+void pipeline_render(const uint8_t *vram, uint8_t *pixels){
+  for(int line = 0; line < INVADERS_SCREEN_WIDTH; line++){
+    const uint8_t *bytes = vram + line * (INVADERS_SCREEN_HEIGHT / 8);
+    // the line is column line of the picture, drawn from the bottom up
+    uint8_t *column = pixels + (INVADERS_SCREEN_HEIGHT - 1) * INVADERS_SCREEN_WIDTH + line;
+    for(int i = 0; i < INVADERS_SCREEN_HEIGHT / 8; i++){
+      for(int bit = 0; bit < 8; bit++){
+        *column = (bytes[i] >> bit) & 1 ? 255 : 0;
+        column -= INVADERS_SCREEN_WIDTH;
+      }
+    }
+  }
+}
+
+static void *render_main(void *arg){
+  Pipeline *pipeline = (Pipeline *) arg;
+  int tries = 0;
+  for(;;){
+    // done is read first, so an empty ring after it is empty for good
+    int done = atomic_load_explicit(&pipeline->submit_done, memory_order_acquire);
+    Snapshot *snapshot = (Snapshot *) ring_pop(&pipeline->to_render);
+    if(snapshot == NULL){
+      if(done){
+        break;
+      }
+      ring_wait(&tries);
+      continue;
+    }
+    tries = 0;
+    if(pipeline->dedup){
+      // the same value hash_vram() gives for the memory it came from
+      uint64_t hash = hash64(snapshot->vram, INVADERS_VRAM_SIZE, 0);
+      if(hash == pipeline->last_hash && pipeline->rendered){
+        pipeline->duplicates++;
+        ring_push(&pipeline->free_snapshots, snapshot);
+        continue;
+      }
+      pipeline->last_hash = hash;
+    }
+    Picture *picture;
+    int waits = 0;
+    while((picture = (Picture *) ring_pop(&pipeline->free_pictures)) == NULL){
+      pipeline->render_waits++;
+      ring_wait(&waits);
+    }
+    picture->frame = snapshot->frame;
+    picture->cycles = snapshot->cycles;
+    pipeline_render(snapshot->vram, picture->pixels);
+    // there are as many buffers as slots, pushes cannot fail
+    ring_push(&pipeline->free_snapshots, snapshot);
+    uint32_t depth = ring_depth(&pipeline->to_encode);
+    pipeline->encode_depth_sum += depth;
+    if(depth > pipeline->encode_depth_max){
+      pipeline->encode_depth_max = depth;
+    }
+    ring_push(&pipeline->to_encode, picture);
+    pipeline->rendered++;
+  }
+  atomic_store_explicit(&pipeline->render_done, 1, memory_order_release);
+  return NULL;
+}
+
+static void *encode_main(void *arg){
+  Pipeline *pipeline = (Pipeline *) arg;
+  int tries = 0;
+  for(;;){
+    int done = atomic_load_explicit(&pipeline->render_done, memory_order_acquire);
+    Picture *picture = (Picture *) ring_pop(&pipeline->to_encode);
+    if(picture == NULL){
+      if(done){
+        break;
+      }
+      ring_wait(&tries);
+      continue;
+    }
+    tries = 0;
+    if(pipeline->sink.write(pipeline->sink.ctx, picture) != 0){
+      pipeline->encode_errors++;
+    }
+    ring_push(&pipeline->free_pictures, picture);
+    pipeline->encoded++;
+  }
+  return NULL;
+}
+
+Pipeline *pipeline_create(FrameSink sink, int lossless, uint32_t every, int dedup){
+  if(dedup && !sink.gaps){
+    return NULL;
+  }
+  Pipeline *pipeline = (Pipeline *) calloc(1, sizeof(Pipeline));
+  pipeline->sink = sink;
+  pipeline->lossless = lossless;
+  pipeline->every = every ? every : 1;
+  pipeline->dedup = dedup;
+  pipeline->snapshots = (Snapshot *) malloc(PIPELINE_DEPTH * sizeof(Snapshot));
+  pipeline->pictures = (Picture *) malloc(PIPELINE_DEPTH * sizeof(Picture));
+  ring_init(&pipeline->to_render, PIPELINE_DEPTH);
+  ring_init(&pipeline->free_snapshots, PIPELINE_DEPTH);
+  ring_init(&pipeline->to_encode, PIPELINE_DEPTH);
+  ring_init(&pipeline->free_pictures, PIPELINE_DEPTH);
+  for(int i = 0; i < PIPELINE_DEPTH; i++){
+    ring_push(&pipeline->free_snapshots, &pipeline->snapshots[i]);
+    ring_push(&pipeline->free_pictures, &pipeline->pictures[i]);
+  }
+  atomic_init(&pipeline->submit_done, 0);
+  atomic_init(&pipeline->render_done, 0);
+  if(pthread_create(&pipeline->render_thread, NULL, render_main, pipeline) != 0){
+    pipeline_free(pipeline);
+    return NULL;
+  }
+  if(pthread_create(&pipeline->encode_thread, NULL, encode_main, pipeline) != 0){
+    atomic_store(&pipeline->submit_done, 1);
+    pthread_join(pipeline->render_thread, NULL);
+    pipeline_free(pipeline);
+    return NULL;
+  }
+  return pipeline;
+}
+
+int pipeline_submit(Pipeline *pipeline, const uint8_t *memory, uint64_t frame, uint64_t cycles){
+  if(frame % pipeline->every){
+    pipeline->skipped++;
+    return -1;
+  }
+  Snapshot *snapshot = (Snapshot *) ring_pop(&pipeline->free_snapshots);
+  if(snapshot == NULL){
+    if(!pipeline->lossless){
+      pipeline->dropped++;
+      return -1;
+    }
+    pipeline->stalls++;
+    int tries = 0;
+    while((snapshot = (Snapshot *) ring_pop(&pipeline->free_snapshots)) == NULL){
+      ring_wait(&tries);
+    }
+  }
+  snapshot->frame = frame;
+  snapshot->cycles = cycles;
+  memcpy(snapshot->vram, memory + INVADERS_VRAM, INVADERS_VRAM_SIZE);
+  uint32_t depth = ring_depth(&pipeline->to_render);
+  pipeline->render_depth_sum += depth;
+  if(depth > pipeline->render_depth_max){
+    pipeline->render_depth_max = depth;
+  }
+  ring_push(&pipeline->to_render, snapshot);
+  pipeline->submitted++;
+  return 0;
+}
+
+int pipeline_close(Pipeline *pipeline){
+  atomic_store_explicit(&pipeline->submit_done, 1, memory_order_release);
+  pthread_join(pipeline->render_thread, NULL);
+  pthread_join(pipeline->encode_thread, NULL);
+  int status = pipeline->encode_errors ? -1 : 0;
+  if(pipeline->sink.close && pipeline->sink.close(pipeline->sink.ctx) != 0){
+    status = -1;
+  }
+  return status;
+}
+
+void pipeline_report(Pipeline *pipeline, FILE *f){
+  fprintf(f, "capture: %llu frames submitted, %llu skipped, %llu dropped, %llu stalls waiting for a buffer\n",
+          (unsigned long long) pipeline->submitted, (unsigned long long) pipeline->skipped,
+          (unsigned long long) pipeline->dropped, (unsigned long long) pipeline->stalls);
+  fprintf(f, "render:  %llu frames, %llu duplicates, queue depth mean %.2f max %u, %llu waits for a picture\n",
+          (unsigned long long) pipeline->rendered, (unsigned long long) pipeline->duplicates,
+          pipeline->submitted ? (double) pipeline->render_depth_sum / pipeline->submitted : 0.0,
+          pipeline->render_depth_max, (unsigned long long) pipeline->render_waits);
+  fprintf(f, "encode:  %llu frames, queue depth mean %.2f max %u, %llu write errors\n",
+          (unsigned long long) pipeline->encoded,
+          pipeline->rendered ? (double) pipeline->encode_depth_sum / pipeline->rendered : 0.0,
+          pipeline->encode_depth_max, (unsigned long long) pipeline->encode_errors);
+}
+
+void pipeline_free(Pipeline *pipeline){
+  ring_free(&pipeline->to_render);
+  ring_free(&pipeline->free_snapshots);
+  ring_free(&pipeline->to_encode);
+  ring_free(&pipeline->free_pictures);
+  free(pipeline->snapshots);
+  free(pipeline->pictures);
+  free(pipeline);
+}
@@ -0,0 +1,122 @@
+#ifndef __PIPELINE__
+#define __PIPELINE__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "machine.h"
+#include "ring.h"
+
+// buffers of each kind, also the most frames a stage can fall behind
+#define PIPELINE_DEPTH 8
+
+// video RAM as it was when a frame ended
+typedef struct Snapshot {
+  uint64_t frame;
+  uint64_t cycles;
+  uint8_t vram[INVADERS_VRAM_SIZE];
+} Snapshot;
+
+// the upright picture, one byte per pixel, 0 or 255
+typedef struct Picture {
+  uint64_t frame;
+  uint64_t cycles;
+  uint8_t pixels[INVADERS_SCREEN_WIDTH * INVADERS_SCREEN_HEIGHT];
+} Picture;
+
+/*
+ * where the encode stage sends pictures, in frame order. write and close
+ * return 0 or -1 on an error, close may be NULL. gaps is set for sinks
+ * that place each picture by its frame number; a stream at a fixed rate
+ * would play faster with frames missing, so it cannot take dedup
+ */
+typedef struct FrameSink {
+  void *ctx;
+  int (*write)(void *ctx, const Picture *picture);
+  int (*close)(void *ctx);
+  int gaps;
+} FrameSink;
+
+/*
+ * Capture runs as three threads so converting and writing frames never
+ * holds up the CPU core: the emulation thread copies video RAM into a
+ * Snapshot, a render thread turns it into a Picture and an encode thread
+ * hands that to the sink. Work moves forward through SPSC rings and the
+ * buffers come back through another ring per kind to be reused, nothing
+ * is allocated per frame. When the render stage is behind and every
+ * snapshot is in use the frame is dropped, or in lossless mode the
+ * emulation thread waits for a buffer. Only every Nth frame is captured,
+ * skipped before anything is copied, and with dedup the render thread
+ * leaves out frames whose video RAM hashes the same as the last one it
+ * passed on. Each counter is written by one thread only
+ */
+typedef struct Pipeline {
+  Snapshot *snapshots;
+  Picture *pictures;
+  // emulation to render and back
+  Ring to_render;
+  Ring free_snapshots;
+  // render to encode and back
+  Ring to_encode;
+  Ring free_pictures;
+  FrameSink sink;
+  int lossless;
+  uint32_t every;
+  int dedup;
+  pthread_t render_thread;
+  pthread_t encode_thread;
+  _Atomic int submit_done;
+  _Atomic int render_done;
+  // emulation thread
+  uint64_t skipped;
+  uint64_t submitted;
+  uint64_t dropped;
+  uint64_t stalls;
+  uint64_t render_depth_sum;
+  uint32_t render_depth_max;
+  // render thread
+  uint64_t duplicates;
+  uint64_t last_hash;
+  uint64_t rendered;
+  uint64_t render_waits;
+  uint64_t encode_depth_sum;
+  uint32_t encode_depth_max;
+  // encode thread
+  uint64_t encoded;
+  uint64_t encode_errors;
+} Pipeline;
+
+/*
+ * the picture for a video RAM snapshot
+ */
+void pipeline_render(const uint8_t *vram, uint8_t *pixels);
+
+/*
+ * start the render and encode threads capturing frames whose number is a
+ * multiple of every, NULL if they could not be started or dedup was asked
+ * of a sink without gaps
+ */
+Pipeline *pipeline_create(FrameSink sink, int lossless, uint32_t every, int dedup);
+
+/*
+ * hand over the frame in memory, from the emulation thread. Returns 0 or
+ * -1 when it was skipped or dropped
+ */
+int pipeline_submit(Pipeline *pipeline, const uint8_t *memory, uint64_t frame, uint64_t cycles);
+
+/*
+ * finish every submitted frame, stop the threads and close the sink,
+ * returns -1 if any write or the close failed
+ */
+int pipeline_close(Pipeline *pipeline);
+
+/*
+ * frames through each stage, drops, stalls and queue depths, once the
+ * pipeline is closed
+ */
+void pipeline_report(Pipeline *pipeline, FILE *f);
+
+void pipeline_free(Pipeline *pipeline);
+
+#endif
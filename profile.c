@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "profile.h"
+#include "opcodes.h"
+
+/*
+ * allocate a zeroed profile
+ */
+Profile *profile_create(void){
+  return (Profile *) calloc(1, sizeof(Profile));
+}
+
+void profile_free(Profile *profile){
+  free(profile);
+}
+
+/*
+ * qsort comparator ordering indices by descending cycle count,
+ * the counter array being sorted is passed through sort_key
+ */
+static const uint64_t *sort_key;
+
+static int by_cycles(const void *x, const void *y){
+  uint64_t a = sort_key[*(const uint32_t *) x];
+  uint64_t b = sort_key[*(const uint32_t *) y];
+  if(a != b){
+    return a < b ? 1 : -1;
+  }
+  return *(const uint32_t *) x - *(const uint32_t *) y;
+}
+
+/*
+ * fill idx with 0..n-1 sorted by descending cycles
+ */
+static void sort_indices(uint32_t *idx, uint32_t n, const uint64_t *cycles){
+  for(uint32_t i = 0; i < n; i++){
+    idx[i] = i;
+  }
+  sort_key = cycles;
+  qsort(idx, n, sizeof(*idx), by_cycles);
+}
+
+static double percent(uint64_t part, uint64_t whole){
+  return whole ? 100.0 * part / whole : 0.0;
+}
+
+/*
+ * print the opcodes and the program counters that took the most cycles,
+ * at most top rows per table (all used opcodes if top <= 0)
+ */
+void profile_report(Profile *profile, FILE *out, int top){
+  uint32_t *idx = (uint32_t *) malloc((1 << 16) * sizeof(*idx));
+
+  fprintf(out, "instructions: %llu\n", (unsigned long long) profile->instructions);
+  fprintf(out, "cycles: %llu\n\n", (unsigned long long) profile->cycles);
+
+  fprintf(out, "%-6s %-12s %14s %14s %7s\n", "opcode", "name", "count", "cycles", "%cyc");
+  sort_indices(idx, 256, profile->op_cycles);
+  for(int i = 0; i < 256 && (top <= 0 || i < top); i++){
+    uint32_t op = idx[i];
+    if(profile->op_count[op] == 0){
+      break;
+    }
+    fprintf(out, "0x%02x   %-12s %14llu %14llu %6.2f%%\n", op, opcode_names[op],
+            (unsigned long long) profile->op_count[op],
+            (unsigned long long) profile->op_cycles[op],
+            percent(profile->op_cycles[op], profile->cycles));
+  }
+
+  fprintf(out, "\n%-6s %14s %14s %7s\n", "pc", "count", "cycles", "%cyc");
+  sort_indices(idx, 1 << 16, profile->pc_cycles);
+  for(int i = 0; i < (1 << 16) && (top <= 0 || i < top); i++){
+    uint32_t pc = idx[i];
+    if(profile->pc_count[pc] == 0){
+      break;
+    }
+    fprintf(out, "0x%04x %14llu %14llu %6.2f%%\n", pc,
+            (unsigned long long) profile->pc_count[pc],
+            (unsigned long long) profile->pc_cycles[pc],
+            percent(profile->pc_cycles[pc], profile->cycles));
+  }
+
+  free(idx);
+}
+
+/*
+ * write every used opcode and program counter as JSON, returns 0 on success
+ */
+int profile_write_json(Profile *profile, const char *path){
+  FILE *f = fopen(path, "w");
+  if(f == NULL){
+    return -1;
+  }
+
+  fprintf(f, "{\n  \"instructions\": %llu,\n  \"cycles\": %llu,\n",
+          (unsigned long long) profile->instructions,
+          (unsigned long long) profile->cycles);
+
+  fprintf(f, "  \"opcodes\": [");
+  int first = 1;
+  for(int op = 0; op < 256; op++){
+    if(profile->op_count[op] == 0){
+      continue;
+    }
+    fprintf(f, "%s\n    {\"opcode\": %d, \"name\": \"%s\", \"count\": %llu, \"cycles\": %llu}",
+            first ? "" : ",", op, opcode_names[op],
+            (unsigned long long) profile->op_count[op],
+            (unsigned long long) profile->op_cycles[op]);
+    first = 0;
+  }
+  fprintf(f, "\n  ],\n");
+
+  fprintf(f, "  \"pcs\": [");
+  first = 1;
+  for(int pc = 0; pc < (1 << 16); pc++){
+    if(profile->pc_count[pc] == 0){
+      continue;
+    }
+    fprintf(f, "%s\n    {\"pc\": %d, \"count\": %llu, \"cycles\": %llu}",
+            first ? "" : ",", pc,
+            (unsigned long long) profile->pc_count[pc],
+            (unsigned long long) profile->pc_cycles[pc]);
+    first = 0;
+  }
+  fprintf(f, "\n  ]\n}\n");
+
+  return fclose(f);
+}
@@ -0,0 +1,39 @@
+#ifndef __PROFILE__
+#define __PROFILE__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * execution and cycle counters per opcode and per program counter
+ */
+typedef struct Profile {
+  uint64_t instructions;
+  uint64_t cycles;
+  uint64_t op_count[256];
+  uint64_t op_cycles[256];
+  uint64_t pc_count[1 << 16];
+  uint64_t pc_cycles[1 << 16];
+} Profile;
+
+Profile *profile_create(void);
+
+void profile_free(Profile *profile);
+
+/*
+ * count one executed instruction, called with the pc and opcode it was fetched at
+ */
+static inline void profile_record(Profile *profile, uint16_t pc, uint8_t opcode, int cycles){
+  profile->instructions++;
+  profile->cycles += cycles;
+  profile->op_count[opcode]++;
+  profile->op_cycles[opcode] += cycles;
+  profile->pc_count[pc]++;
+  profile->pc_cycles[pc] += cycles;
+}
+
+void profile_report(Profile *profile, FILE *out, int top);
+
+int profile_write_json(Profile *profile, const char *path);
+
+#endif
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "emulator.h"
+#include "opcodes.h"
+#include "rom.h"
+#include "machine.h"
+#include "romindex.h"
+#include "idiom.h"
+
+/*
+ * Ahead of time translation of a ROM to C: every basic block of the index
+ * becomes a label whose instructions are aot_step() calls with constant
+ * opcodes, so -O2 compiles each one down to its handler. Block ends go
+ * straight to the labels of known successors, anything else through a
+ * table of block labels, both only while the gate lets them. aot_run()
+ * opens every block and interprets what has none (see aot.h). Blocks
+ * that are a whole copy or fill loop try aot_idiom() first
+ */
+
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-r rom_folder] [-i index] [-o output.c]\n", name);
+  exit(1);
+}
+
+/*
+ * jump to the block at adr if the run ended there
+ */
+void emit_successor(FILE *f, RomIndex *index, uint16_t adr){
+  if(adr < index->size && index->block_at[adr] >= 0){
+    fprintf(f, "  if(r.pc == 0x%04x && r.gate[0x%04x]) goto L%04x;\n", adr, adr, adr);
+  }
+}
+
+void emit_block(FILE *f, RomIndex *index, RomBlock *block, const uint8_t *memory){
+  int cycles = 0;
+  for(uint32_t pc = block->start; pc < block->end; pc += opcode_lengths[memory[pc]]){
+    cycles += opcode_cycles[memory[pc]];
+  }
+  Idiom idiom;
+  int loop = block->kind == BLOCK_BRANCH && block->taken == block->start && idiom_match(memory, block->start, &idiom);
+  if(block->routine == block->start){
+    fprintf(f, "\n  // routine %04x\n", block->start);
+  }
+  fprintf(f, "L%04x:\n", block->start);
+  if(loop){
+    fprintf(f, "  spent = aot_idiom(&r, &idiom_%04x, budget - cycles, &count);\n", block->start);
+    fprintf(f, "  if(spent){\n");
+    fprintf(f, "    cycles += spent;\n");
+    fprintf(f, "    goto E%04x;\n", block->start);
+    fprintf(f, "  }\n");
+  }
+  fprintf(f, "  cycles += %d;\n", cycles);
+  fprintf(f, "  count += %d;\n", block->instructions);
+  int left = cycles;
+  int n = block->instructions;
+  for(uint32_t pc = block->start; pc < block->end; pc += opcode_lengths[memory[pc]]){
+    uint8_t op = memory[pc];
+    int extra = (op & 0xc7) == 0xc0 || (op & 0xc7) == 0xc4;
+    fprintf(f, "  r.pc = 0x%04x; %saot_step(&r, 0x%02x); // %s\n", pc + 1, extra ? "cycles += " : "", op, opcode_names[op]);
+    left -= opcode_cycles[op];
+    n--;
+    if(n > 0 && (opcode_stores(op) || op == 0xfb || op == 0xd3)){
+      // the store may have changed the rest of the block, leave without it,
+      // as after EI and OUT
+      fprintf(f, "  if(r.touched){ cycles -= %d; count -= %d; goto done; }\n", left, n);
+    }
+  }
+  if(loop){
+    fprintf(f, "E%04x:\n", block->start);
+  }
+  fprintf(f, "  if(cycles >= budget || r.touched) goto done;\n");
+  switch(block->kind){
+    case BLOCK_FALL:
+      emit_successor(f, index, block->next);
+      break;
+    case BLOCK_JUMP:
+      emit_successor(f, index, block->taken);
+      break;
+    case BLOCK_BRANCH:
+    case BLOCK_CALL:
+      emit_successor(f, index, block->taken);
+      emit_successor(f, index, block->next);
+      break;
+    case BLOCK_RET_COND:
+      emit_successor(f, index, block->next);
+      break;
+  }
+  fprintf(f, "  goto dispatch;\n");
+}
+
+int emit(RomIndex *index, const uint8_t *memory, const char *source, const char *path){
+  FILE *f = fopen(path, "w");
+  if(f == NULL){
+    return -1;
+  }
+  fprintf(f, "/*\n * generated by recompile from %s, do not edit\n */\n", source);
+  fprintf(f, "#include \"aot.h\"\n\n");
+  fprintf(f, "const uint32_t aot_rom_size = 0x%04x;\n\n", index->size);
+  fprintf(f, "const uint32_t aot_rom_checksum = 0x%08x;\n\n", index->checksum);
+  fprintf(f, "const int aot_block_count = %d;\n\n", index->block_count);
+  fprintf(f, "const AotBlock aot_blocks[] = {\n");
+  for(int i = 0; i < index->block_count; i++){
+    fprintf(f, "  {0x%04x, 0x%04x},\n", index->blocks[i].start, index->blocks[i].end);
+  }
+  fprintf(f, "};\n\n");
+  for(int i = 0; i < index->block_count; i++){
+    RomBlock *block = &index->blocks[i];
+    Idiom idiom;
+    if(block->kind == BLOCK_BRANCH && block->taken == block->start && idiom_match(memory, block->start, &idiom)){
+      fprintf(f, "static const Idiom idiom_%04x = {.kind = %d, .start = 0x%04x, .end = 0x%04x, .cycles = %d, .instructions = %d,\n",
+              block->start, idiom.kind, idiom.start, idiom.end, idiom.cycles, idiom.instructions);
+      fprintf(f, "  .counter = %d, .value = %d, .immediate = 0x%02x, .src = %d, .dst = %d, .limit = 0x%02x};\n\n",
+              idiom.counter, idiom.value, idiom.immediate, idiom.src, idiom.dst, idiom.limit);
+    }
+  }
+  fprintf(f, "static const uint8_t open_gate[0x%04x] = {[0 ... 0x%04x] = 1};\n\n", index->size, index->size - 1);
+  fprintf(f, "static uint8_t unwatched[256];\n\n");
+  fprintf(f, "int aot_run(State8080 *state, int budget, uint64_t *instructions){\n");
+  fprintf(f, "  int cycles = 0;\n");
+  fprintf(f, "  int touched;\n");
+  // a write from before is held back so the loop stops at one of its own
+  fprintf(f, "  uint8_t pending = state->out_written;\n");
+  fprintf(f, "  state->out_written = 0;\n");
+  fprintf(f, "  state->int_delay = 0;\n");
+  fprintf(f, "  while(cycles < budget && !state->int_delay && !state->out_written){\n");
+  fprintf(f, "    cycles += aot_run_gated(state, budget - cycles, instructions, open_gate, unwatched, &touched);\n");
+  fprintf(f, "    if(cycles < budget && !state->int_delay && !state->out_written){\n");
+  fprintf(f, "      cycles += emulate(state);\n");
+  fprintf(f, "      (*instructions)++;\n");
+  fprintf(f, "    }\n");
+  fprintf(f, "  }\n");
+  fprintf(f, "  state->out_written |= pending;\n");
+  fprintf(f, "  return cycles;\n");
+  fprintf(f, "}\n\n");
+  fprintf(f, "int aot_run_gated(State8080 *state, int budget, uint64_t *instructions, const uint8_t *gate, uint8_t *watch, int *touched){\n");
+  fprintf(f, "  static const void *const blocks[0x%04x] = {\n", index->size);
+  for(int i = 0; i < index->block_count; i++){
+    fprintf(f, "    [0x%04x] = &&L%04x,\n", index->blocks[i].start, index->blocks[i].start);
+  }
+  fprintf(f, "  };\n");
+  fprintf(f, "  AotRegs r;\n");
+  fprintf(f, "  int cycles = 0;\n");
+  fprintf(f, "  int spent;\n");
+  fprintf(f, "  uint64_t count = 0;\n");
+  fprintf(f, "  AOT_LOAD(r, state);\n");
+  fprintf(f, "  r.gate = gate;\n");
+  fprintf(f, "  r.watch = watch;\n");
+  fprintf(f, "  r.touched = 0;\n");
+  fprintf(f, "  state->int_delay = 0;\n");
+  fprintf(f, "  goto dispatch;\n");
+  for(int i = 0; i < index->block_count; i++){
+    emit_block(f, index, &index->blocks[i], memory);
+  }
+  fprintf(f, "\n");
+  fprintf(f, "dispatch:\n");
+  fprintf(f, "  if(r.pc < 0x%04x && blocks[r.pc] && r.gate[r.pc]){\n", index->size);
+  fprintf(f, "    goto *blocks[r.pc];\n");
+  fprintf(f, "  }\n");
+  fprintf(f, "done:\n");
+  fprintf(f, "  AOT_STORE(r, state);\n");
+  fprintf(f, "  *instructions += count;\n");
+  fprintf(f, "  *touched = r.touched;\n");
+  fprintf(f, "  return cycles;\n");
+  fprintf(f, "}\n");
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv){
+  char *folder = "rom";
+  char *index_path = "invaders.idx";
+  char *output_path = "invaders_aot.c";
+  int opt;
+  while((opt = getopt(argc, argv, "r:i:o:")) != -1){
+    switch(opt){
+      case 'r':
+        folder = optarg;
+        break;
+      case 'i':
+        index_path = optarg;
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  uint8_t *memory = (uint8_t *) calloc(MEMORY_ALLOC, 1);
+  load_invaders(memory, folder);
+  RomIndex *index = romindex_load(index_path, memory);
+  if(index == NULL){
+    fprintf(stderr, "%s is missing or was built from another ROM, run make index\n", index_path);
+    return 1;
+  }
+  int status = 0;
+  if(emit(index, memory, index_path, output_path) != 0){
+    fprintf(stderr, "could not write %s\n", output_path);
+    status = 1;
+  }
+  else {
+    printf("%s: %d blocks translated\n", output_path, index->block_count);
+  }
+  romindex_free(index);
+  free(memory);
+  return status;
+}
@@ -0,0 +1,471 @@
+#include <stdint.h>
+#include "ref8080.h"
+
+/*
+ * Reference 8080 core for differential testing. It is written from the
+ * Intel 8080 programmer's manual independently of emulator.c: operands are
+ * decoded from the opcode bit fields (ddd/sss/rp/ccc) instead of one case
+ * per opcode, and it favours obviously correct code over speed. Its cycle
+ * counts come from the manual too rather than from opcodes.c, so a wrong
+ * entry in opcode_cycles[] shows up as a difference.
+ */
+
+static uint8_t rd(State8080 *s, uint16_t adr){
+  return MEM_READ(s, adr);
+}
+
+static void wr(State8080 *s, uint16_t adr, uint8_t val){
+  MEM_WRITE(s, adr, val);
+}
+
+static uint8_t fetch(State8080 *s){
+  return rd(s, s->pc++);
+}
+
+static uint16_t fetch16(State8080 *s){
+  uint8_t lo = fetch(s);
+  return lo | (fetch(s) << 8);
+}
+
+static uint16_t hl(State8080 *s){
+  return (s->h << 8) | s->l;
+}
+
+/*
+ * register by its 3 bit code, 6 is the memory operand M
+ */
+static uint8_t get_reg(State8080 *s, int r){
+  switch(r){
+    case 0: return s->b;
+    case 1: return s->c;
+    case 2: return s->d;
+    case 3: return s->e;
+    case 4: return s->h;
+    case 5: return s->l;
+    case 6: return rd(s, hl(s));
+    default: return s->a;
+  }
+}
+
+static void set_reg(State8080 *s, int r, uint8_t val){
+  switch(r){
+    case 0: s->b = val; break;
+    case 1: s->c = val; break;
+    case 2: s->d = val; break;
+    case 3: s->e = val; break;
+    case 4: s->h = val; break;
+    case 5: s->l = val; break;
+    case 6: wr(s, hl(s), val); break;
+    default: s->a = val; break;
+  }
+}
+
+/*
+ * register pair by its 2 bit code, 3 is SP
+ */
+static uint16_t get_pair(State8080 *s, int rp){
+  switch(rp){
+    case 0: return (s->b << 8) | s->c;
+    case 1: return (s->d << 8) | s->e;
+    case 2: return hl(s);
+    default: return s->sp;
+  }
+}
+
+static void set_pair(State8080 *s, int rp, uint16_t val){
+  switch(rp){
+    case 0: s->b = val >> 8; s->c = val; break;
+    case 1: s->d = val >> 8; s->e = val; break;
+    case 2: s->h = val >> 8; s->l = val; break;
+    default: s->sp = val; break;
+  }
+}
+
+static void push(State8080 *s, uint16_t val){
+  s->sp -= 2;
+  wr(s, s->sp, val & 0xff);
+  wr(s, (uint16_t) (s->sp + 1), val >> 8);
+}
+
+static uint16_t pop(State8080 *s){
+  uint16_t val = rd(s, s->sp) | (rd(s, (uint16_t) (s->sp + 1)) << 8);
+  s->sp += 2;
+  return val;
+}
+
+static int even_parity(uint8_t v){
+  v ^= v >> 4;
+  v ^= v >> 2;
+  v ^= v >> 1;
+  return !(v & 1);
+}
+
+static void set_zsp(State8080 *s, uint8_t v){
+  s->cc.z = v == 0;
+  s->cc.s = v >> 7;
+  s->cc.p = even_parity(v);
+}
+
+/*
+ * condition by its 3 bit code: NZ Z NC C PO PE P M
+ */
+static int condition(State8080 *s, int ccc){
+  int flag;
+  switch(ccc >> 1){
+    case 0: flag = s->cc.z; break;
+    case 1: flag = s->cc.cy; break;
+    case 2: flag = s->cc.p; break;
+    default: flag = s->cc.s; break;
+  }
+  return (ccc & 1) ? flag : !flag;
+}
+
+/*
+ * the adder every arithmetic instruction goes through, subtraction is
+ * done as a + ~v + 1 like the hardware, so AC comes out the same way
+ */
+static uint8_t adder(State8080 *s, uint8_t a, uint8_t v, int carry_in){
+  unsigned sum = a + v + carry_in;
+  s->cc.ac = ((a & 0x0f) + (v & 0x0f) + carry_in) > 0x0f;
+  s->cc.cy = sum > 0xff;
+  set_zsp(s, sum);
+  return sum;
+}
+
+static void alu(State8080 *s, int op, uint8_t v){
+  switch(op){
+    case 0:
+      s->a = adder(s, s->a, v, 0);
+      break;
+    case 1:
+      s->a = adder(s, s->a, v, s->cc.cy);
+      break;
+    case 2:
+      s->a = adder(s, s->a, ~v, 1);
+      s->cc.cy = !s->cc.cy;
+      break;
+    case 3:
+      s->a = adder(s, s->a, ~v, !s->cc.cy);
+      s->cc.cy = !s->cc.cy;
+      break;
+    case 4:
+      s->cc.ac = ((s->a | v) & 0x08) != 0;
+      s->a &= v;
+      s->cc.cy = 0;
+      set_zsp(s, s->a);
+      break;
+    case 5:
+      s->a ^= v;
+      s->cc.cy = 0;
+      s->cc.ac = 0;
+      set_zsp(s, s->a);
+      break;
+    case 6:
+      s->a |= v;
+      s->cc.cy = 0;
+      s->cc.ac = 0;
+      set_zsp(s, s->a);
+      break;
+    default:
+      adder(s, s->a, ~v, 1);
+      s->cc.cy = !s->cc.cy;
+      break;
+  }
+}
+
+static uint8_t psw_flags(State8080 *s){
+  return s->cc.s << 7 | s->cc.z << 6 | s->cc.ac << 4 | s->cc.p << 2 | 0x02 | s->cc.cy;
+}
+
+static void decimal_adjust(State8080 *s){
+  uint8_t correction = 0;
+  int carry = s->cc.cy;
+  if(s->cc.ac || (s->a & 0x0f) > 9){
+    correction |= 0x06;
+  }
+  if(s->cc.cy || (s->a >> 4) > 9 || ((s->a >> 4) >= 9 && (s->a & 0x0f) > 9)){
+    correction |= 0x60;
+    carry = 1;
+  }
+  s->a = adder(s, s->a, correction, 0);
+  s->cc.cy = carry;
+}
+
+/*
+ * states of an instruction by its fields as the manual lists them, those
+ * of a conditional call or return that is not taken
+ */
+static int states(uint8_t op){
+  int ddd = (op >> 3) & 7;
+  int sss = op & 7;
+  if(op == 0x76){
+    return 7;
+  }
+  if((op & 0xc0) == 0x40){
+    return ddd == 6 || sss == 6 ? 7 : 5;
+  }
+  if((op & 0xc0) == 0x80){
+    return sss == 6 ? 7 : 4;
+  }
+  if((op & 0xc0) == 0x00){
+    switch(sss){
+      case 0: return 4;
+      case 1: return 10;
+      // STAX/LDAX, SHLD/LHLD, STA/LDA
+      case 2: return ddd < 4 ? 7 : ddd < 6 ? 16 : 13;
+      case 3: return 5;
+      case 4: case 5: return ddd == 6 ? 10 : 5;
+      case 6: return ddd == 6 ? 10 : 7;
+      default: return 4;
+    }
+  }
+  switch(sss){
+    case 0: return 5;
+    // RET, PCHL, SPHL, POP
+    case 1: return ddd == 5 || ddd == 7 ? 5 : 10;
+    case 2: return 10;
+    // JMP, OUT, IN, XTHL, XCHG, DI, EI
+    case 3: return ddd < 4 ? 10 : ddd == 4 ? 18 : 4;
+    case 4: return 11;
+    // CALL, PUSH
+    case 5: return ddd & 1 ? 17 : 11;
+    case 6: return 7;
+    default: return 11;
+  }
+}
+
+int ref_step(State8080 *s){
+  uint8_t op = fetch(s);
+  int cycles = states(op);
+  int ddd = (op >> 3) & 7;
+  int sss = op & 7;
+  int rp = (op >> 4) & 3;
+  // an EI holds interrupts off for one instruction only
+  s->int_delay = 0;
+
+  if(op == 0x76){
+    return cycles;
+  }
+  if((op & 0xc0) == 0x40){
+    set_reg(s, ddd, get_reg(s, sss));
+    return cycles;
+  }
+  if((op & 0xc0) == 0x80){
+    alu(s, ddd, get_reg(s, sss));
+    return cycles;
+  }
+
+  if((op & 0xc0) == 0x00){
+    switch(sss){
+      case 0:
+        break;
+
+      case 1:
+        if(op & 0x08){
+          uint32_t sum = hl(s) + get_pair(s, rp);
+          s->cc.cy = sum > 0xffff;
+          set_pair(s, 2, sum);
+        }
+        else {
+          set_pair(s, rp, fetch16(s));
+        }
+        break;
+
+      case 2:
+        switch(ddd){
+          case 0: wr(s, get_pair(s, 0), s->a); break;
+          case 1: s->a = rd(s, get_pair(s, 0)); break;
+          case 2: wr(s, get_pair(s, 1), s->a); break;
+          case 3: s->a = rd(s, get_pair(s, 1)); break;
+          case 4: {
+            uint16_t adr = fetch16(s);
+            wr(s, adr, s->l);
+            wr(s, (uint16_t) (adr + 1), s->h);
+            break;
+          }
+          case 5: {
+            uint16_t adr = fetch16(s);
+            s->l = rd(s, adr);
+            s->h = rd(s, (uint16_t) (adr + 1));
+            break;
+          }
+          case 6: wr(s, fetch16(s), s->a); break;
+          default: s->a = rd(s, fetch16(s)); break;
+        }
+        break;
+
+      case 3:
+        set_pair(s, rp, get_pair(s, rp) + ((op & 0x08) ? -1 : 1));
+        break;
+
+      case 4: {
+        uint8_t v = get_reg(s, ddd) + 1;
+        s->cc.ac = (v & 0x0f) == 0;
+        set_zsp(s, v);
+        set_reg(s, ddd, v);
+        break;
+      }
+
+      case 5: {
+        uint8_t v = get_reg(s, ddd) - 1;
+        s->cc.ac = (v & 0x0f) != 0x0f;
+        set_zsp(s, v);
+        set_reg(s, ddd, v);
+        break;
+      }
+
+      case 6:
+        set_reg(s, ddd, fetch(s));
+        break;
+
+      default:
+        switch(ddd){
+          case 0:
+            s->cc.cy = s->a >> 7;
+            s->a = (s->a << 1) | s->cc.cy;
+            break;
+          case 1:
+            s->cc.cy = s->a & 1;
+            s->a = (s->a >> 1) | (s->cc.cy << 7);
+            break;
+          case 2: {
+            int carry = s->cc.cy;
+            s->cc.cy = s->a >> 7;
+            s->a = (s->a << 1) | carry;
+            break;
+          }
+          case 3: {
+            int carry = s->cc.cy;
+            s->cc.cy = s->a & 1;
+            s->a = (s->a >> 1) | (carry << 7);
+            break;
+          }
+          case 4: decimal_adjust(s); break;
+          case 5: s->a = ~s->a; break;
+          case 6: s->cc.cy = 1; break;
+          default: s->cc.cy = !s->cc.cy; break;
+        }
+        break;
+    }
+    return cycles;
+  }
+
+  // 0xc0 - 0xff
+  switch(sss){
+    case 0:
+      if(condition(s, ddd)){
+        s->pc = pop(s);
+        cycles = 11;
+      }
+      break;
+
+    case 1:
+      switch(ddd){
+        case 1: case 3:
+          s->pc = pop(s);
+          break;
+        case 5:
+          s->pc = hl(s);
+          break;
+        case 7:
+          s->sp = hl(s);
+          break;
+        case 6: {
+          uint16_t v = pop(s);
+          s->a = v >> 8;
+          s->cc.s = (v >> 7) & 1;
+          s->cc.z = (v >> 6) & 1;
+          s->cc.ac = (v >> 4) & 1;
+          s->cc.p = (v >> 2) & 1;
+          s->cc.cy = v & 1;
+          break;
+        }
+        default:
+          set_pair(s, rp, pop(s));
+          break;
+      }
+      break;
+
+    case 2: {
+      uint16_t adr = fetch16(s);
+      if(condition(s, ddd)){
+        s->pc = adr;
+      }
+      break;
+    }
+
+    case 3:
+      switch(ddd){
+        case 0: case 1:
+          s->pc = fetch16(s);
+          break;
+        case 2:
+          // OUT is left in the latch for whoever runs the core
+          s->out_port = fetch(s);
+          s->out_value = s->a;
+          s->out_written = 1;
+          break;
+        case 3:
+          // IN has no device behind it here
+          fetch(s);
+          break;
+        case 4: {
+          uint8_t l = rd(s, s->sp);
+          uint8_t h = rd(s, (uint16_t) (s->sp + 1));
+          wr(s, s->sp, s->l);
+          wr(s, (uint16_t) (s->sp + 1), s->h);
+          s->l = l;
+          s->h = h;
+          break;
+        }
+        case 5: {
+          uint16_t de = get_pair(s, 1);
+          set_pair(s, 1, hl(s));
+          set_pair(s, 2, de);
+          break;
+        }
+        case 6:
+          s->int_enable = 0;
+          break;
+        default:
+          s->int_enable = 1;
+          s->int_delay = 1;
+          break;
+      }
+      break;
+
+    case 4: {
+      uint16_t adr = fetch16(s);
+      if(condition(s, ddd)){
+        push(s, s->pc);
+        s->pc = adr;
+        cycles = 17;
+      }
+      break;
+    }
+
+    case 5:
+      if(ddd & 1){
+        uint16_t adr = fetch16(s);
+        push(s, s->pc);
+        s->pc = adr;
+      }
+      else if(rp == 3){
+        push(s, (s->a << 8) | psw_flags(s));
+      }
+      else {
+        push(s, get_pair(s, rp));
+      }
+      break;
+
+    case 6:
+      alu(s, ddd, fetch(s));
+      break;
+
+    default:
+      push(s, s->pc);
+      s->pc = ddd << 3;
+      break;
+  }
+  return cycles;
+}
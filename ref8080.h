@@ -0,0 +1,11 @@
+#ifndef __REF8080__
+#define __REF8080__
+
+#include "emulator.h"
+
+/*
+ * execute one instruction with the reference core, returns its cycles
+ */
+int ref_step(State8080 *state);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __RING__
+#define __RING__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+
+/*
+ * Lock-free ring of pointers between exactly one producer thread and one
+ * consumer thread. Each side owns one index and only reads the other's:
+ * the producer publishes a slot with a release store of head after filling
+ * it, the consumer frees it with a release store of tail after emptying
+ * it. The indices run freely and are masked, so capacity is a power of
+ * two and every slot is usable. They sit on their own cache lines so the
+ * two threads do not bounce one line between them
+ */
+typedef struct Ring {
+  _Atomic uint32_t head __attribute__((aligned(64)));
+  _Atomic uint32_t tail __attribute__((aligned(64)));
+  uint32_t mask __attribute__((aligned(64)));
+  void **slots;
+} Ring;
+
+/*
+ * capacity is rounded up to a power of two
+ */
+static inline void ring_init(Ring *ring, uint32_t capacity){
+  uint32_t size = 1;
+  while(size < capacity){
+    size <<= 1;
+  }
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->mask = size - 1;
+  ring->slots = (void **) calloc(size, sizeof(void *));
+}
+
+static inline void ring_free(Ring *ring){
+  free(ring->slots);
+}
+
+/*
+ * producer side, 0 or -1 when the ring is full
+ */
+static inline int ring_push(Ring *ring, void *item){
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if(head - tail > ring->mask){
+    return -1;
+  }
+  ring->slots[head & ring->mask] = item;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return 0;
+}
+
+/*
+ * consumer side, NULL when the ring is empty
+ */
+static inline void *ring_pop(Ring *ring){
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if(head == tail){
+    return NULL;
+  }
+  void *item = ring->slots[tail & ring->mask];
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return item;
+}
+
+/*
+ * wait for the other end, yielding at first and then sleeping so an idle
+ * thread does not take the CPU from the emulation thread. Reset tries to
+ * 0 once the ring moves
+ */
+static inline void ring_wait(int *tries){
+  if((*tries)++ < 16){
+    sched_yield();
+    return;
+  }
+  struct timespec ts = {0, 50000};
+  nanosleep(&ts, NULL);
+}
+
+/*
+ * items waiting, exact from either side and a snapshot from anywhere else
+ */
+static inline uint32_t ring_depth(Ring *ring){
+  return atomic_load_explicit(&ring->head, memory_order_acquire) - atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+#endif
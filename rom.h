@@ -0,0 +1,11 @@
+#ifndef __ROM__
+#define __ROM__
+
+#include <stdint.h>
+#include "emulator.h"
+
+void load_invaders_chunk(char *folder, char chunk, uint8_t *memory);
+
+void load_invaders(uint8_t *memory, char *folder);
+
+#endif
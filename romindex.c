@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "romindex.h"
+#include "emulator.h"
+#include "opcodes.h"
+
+const char *block_kind_names[BLOCK_KINDS] = {
+  "fall", "jump", "branch", "call", "ret", "retc", "pchl"
+};
+
+/*
+ * how an opcode transfers control, BLOCK_FALL for everything that just
+ * moves on to the next instruction. Undocumented aliases behave as in
+ * emulate(): 0xcb is JMP, 0xd9 RET and 0xdd/0xed/0xfd CALL
+ */
+int opcode_flow(uint8_t op){
+  switch(op){
+    case 0xc3: case 0xcb:
+      return BLOCK_JUMP;
+    case 0xcd: case 0xdd: case 0xed: case 0xfd:
+      return BLOCK_CALL;
+    case 0xc9: case 0xd9:
+      return BLOCK_RET;
+    case 0xe9:
+      return BLOCK_INDIRECT;
+  }
+  switch(op & 0xc7){
+    case 0xc2:
+      return BLOCK_BRANCH;
+    case 0xc4: case 0xc7:
+      return BLOCK_CALL;
+    case 0xc0:
+      return BLOCK_RET_COND;
+  }
+  return BLOCK_FALL;
+}
+
+int opcode_stores(uint8_t op){
+  switch(op){
+    case 0x02: case 0x12: case 0x22: case 0x32: // STAX B, STAX D, SHLD, STA
+    case 0x34: case 0x35: case 0x36: // INR M, DCR M, MVI M
+    case 0xe3: // XTHL
+      return 1;
+  }
+  // MOV M,r and PUSH
+  return (op >= 0x70 && op <= 0x77 && op != 0x76) || (op & 0xcf) == 0xc5;
+}
+
+/*
+ * destination of a jump, call or RST at adr
+ */
+static uint16_t opcode_target(const uint8_t *memory, uint16_t adr){
+  uint8_t op = memory[adr];
+  if((op & 0xc7) == 0xc7){
+    return op & 0x38;
+  }
+  return make_word(memory[adr + 2], memory[adr + 1]);
+}
+
+uint32_t romindex_checksum(const uint8_t *memory, uint32_t size){
+  uint32_t h = 2166136261u;
+  for(uint32_t i = 0; i < size; i++){
+    h = (h ^ memory[i]) * 16777619u;
+  }
+  return h;
+}
+
+static RomIndex *index_create(uint32_t size){
+  RomIndex *index = (RomIndex *) calloc(1, sizeof(RomIndex));
+  index->size = size;
+  memset(index->block_at, 0xff, sizeof(index->block_at));
+  return index;
+}
+
+static void add_entry(RomIndex *index, uint16_t adr){
+  index->entries = (uint16_t *) realloc(index->entries, (index->entry_count + 1) * sizeof(uint16_t));
+  index->entries[index->entry_count++] = adr;
+}
+
+static RomBlock *add_block(RomIndex *index, int *capacity){
+  if(index->block_count == *capacity){
+    *capacity = *capacity ? *capacity * 2 : 256;
+    index->blocks = (RomBlock *) realloc(index->blocks, *capacity * sizeof(RomBlock));
+  }
+  RomBlock *block = &index->blocks[index->block_count];
+  memset(block, 0, sizeof(*block));
+  return block;
+}
+
+/*
+ * queue an address for decoding unless it already was
+ */
+typedef struct Walk {
+  uint16_t work[1 << 16];
+  int top;
+  uint8_t queued[1 << 16];
+} Walk;
+
+static void walk_push(Walk *walk, uint16_t adr){
+  if(!walk->queued[adr]){
+    walk->queued[adr] = 1;
+    walk->work[walk->top++] = adr;
+  }
+}
+
+/*
+ * decode every path reachable from the queued addresses, marking
+ * instruction and operand bytes. A path stops at an unconditional transfer,
+ * at code decoded before or where it would overlap another instruction
+ */
+static void walk_decode(RomIndex *index, Walk *walk, const uint8_t *memory){
+  while(walk->top > 0){
+    uint32_t adr = walk->work[--walk->top];
+    while(1){
+      if(adr >= index->size){
+        index->externals++;
+        break;
+      }
+      if(index->flags[adr] & ROMINDEX_CODE){
+        // joined a path decoded earlier, which now has two ways in
+        index->flags[adr] |= ROMINDEX_LEADER;
+        break;
+      }
+      uint8_t op = memory[adr];
+      int len = opcode_lengths[op];
+      int clash = adr + len > index->size || (index->flags[adr] & ROMINDEX_OPERAND);
+      for(int i = 1; i < len && !clash; i++){
+        clash = (index->flags[adr + i] & (ROMINDEX_CODE | ROMINDEX_OPERAND)) != 0;
+      }
+      if(clash){
+        index->conflicts++;
+        break;
+      }
+      index->flags[adr] |= ROMINDEX_CODE;
+      for(int i = 1; i < len; i++){
+        index->flags[adr + i] |= ROMINDEX_OPERAND;
+      }
+
+      int kind = opcode_flow(op);
+      uint32_t next = adr + len;
+      if(kind == BLOCK_JUMP || kind == BLOCK_BRANCH || kind == BLOCK_CALL){
+        uint16_t target = opcode_target(memory, adr);
+        if(target < index->size){
+          index->flags[target] |= kind == BLOCK_CALL ? ROMINDEX_ROUTINE : ROMINDEX_TARGET;
+          index->flags[target] |= ROMINDEX_LEADER;
+          walk_push(walk, target);
+        }
+        else {
+          index->externals++;
+        }
+      }
+      if(kind == BLOCK_INDIRECT){
+        index->flags[adr] |= ROMINDEX_INDIRECT;
+      }
+      if(kind == BLOCK_JUMP || kind == BLOCK_RET || kind == BLOCK_INDIRECT){
+        break;
+      }
+      if(kind != BLOCK_FALL && next < index->size){
+        index->flags[next] |= ROMINDEX_LEADER;
+      }
+      adr = next;
+    }
+  }
+}
+
+/*
+ * cut the decoded code into basic blocks at every leader and after every
+ * control transfer
+ */
+static void build_blocks(RomIndex *index, const uint8_t *memory){
+  int capacity = 0;
+  for(uint32_t adr = 0; adr < index->size; adr++){
+    if((index->flags[adr] & ROMINDEX_LEADER) && !(index->flags[adr] & ROMINDEX_CODE)){
+      // a target that landed inside another instruction
+      index->flags[adr] &= ~(ROMINDEX_LEADER | ROMINDEX_ROUTINE | ROMINDEX_TARGET);
+    }
+  }
+  for(uint32_t adr = 0; adr < index->size; adr++){
+    if(!(index->flags[adr] & ROMINDEX_LEADER)){
+      continue;
+    }
+    RomBlock *block = add_block(index, &capacity);
+    block->start = adr;
+    uint32_t pc = adr;
+    while(1){
+      uint8_t op = memory[pc];
+      int kind = opcode_flow(op);
+      block->instructions++;
+      if(kind != BLOCK_FALL){
+        block->kind = kind;
+        if(kind == BLOCK_JUMP || kind == BLOCK_BRANCH || kind == BLOCK_CALL){
+          block->taken = opcode_target(memory, pc);
+        }
+        pc += opcode_lengths[op];
+        break;
+      }
+      pc += opcode_lengths[op];
+      if(pc >= index->size || !(index->flags[pc] & ROMINDEX_CODE) || (index->flags[pc] & ROMINDEX_LEADER)){
+        block->kind = BLOCK_FALL;
+        break;
+      }
+    }
+    block->end = pc;
+    block->next = pc;
+    index->block_at[adr] = index->block_count++;
+  }
+}
+
+/*
+ * hand each block to the first routine that reaches it without a call,
+ * reset and vectors first, then call targets in address order
+ */
+static void assign_routines(RomIndex *index){
+  uint8_t *owned = (uint8_t *) calloc(index->block_count, 1);
+  int32_t *work = (int32_t *) malloc(index->block_count * sizeof(int32_t));
+  int count = index->entry_count;
+  uint16_t *routines = (uint16_t *) malloc((index->entry_count + index->size) * sizeof(uint16_t));
+  memcpy(routines, index->entries, index->entry_count * sizeof(uint16_t));
+  for(uint32_t adr = 0; adr < index->size; adr++){
+    if(index->flags[adr] & ROMINDEX_ROUTINE){
+      routines[count++] = adr;
+    }
+  }
+
+  for(int r = 0; r < count; r++){
+    int32_t first = index->block_at[routines[r]];
+    if(first < 0 || owned[first]){
+      continue;
+    }
+    int top = 0;
+    owned[first] = 1;
+    work[top++] = first;
+    while(top > 0){
+      RomBlock *block = &index->blocks[work[--top]];
+      block->routine = routines[r];
+      uint32_t succ[2];
+      int n = 0;
+      if(block->kind == BLOCK_JUMP || block->kind == BLOCK_BRANCH){
+        succ[n++] = block->taken;
+      }
+      if(block->kind != BLOCK_JUMP && block->kind != BLOCK_RET && block->kind != BLOCK_INDIRECT){
+        succ[n++] = block->next;
+      }
+      for(int i = 0; i < n; i++){
+        int32_t b = succ[i] < index->size ? index->block_at[succ[i]] : -1;
+        if(b >= 0 && !owned[b]){
+          owned[b] = 1;
+          work[top++] = b;
+        }
+      }
+    }
+  }
+  for(int i = 0; i < index->block_count; i++){
+    if(!owned[i]){
+      index->blocks[i].routine = index->blocks[i].start;
+    }
+  }
+  free(routines);
+  free(work);
+  free(owned);
+}
+
+static int compare_edges(const void *a, const void *b){
+  const CallEdge *x = (const CallEdge *) a;
+  const CallEdge *y = (const CallEdge *) b;
+  if(x->caller != y->caller){
+    return x->caller - y->caller;
+  }
+  return x->callee - y->callee;
+}
+
+/*
+ * one edge per (caller routine, callee), counting the call sites
+ */
+static void build_calls(RomIndex *index){
+  index->calls = (CallEdge *) malloc((index->block_count + 1) * sizeof(CallEdge));
+  int count = 0;
+  for(int i = 0; i < index->block_count; i++){
+    RomBlock *block = &index->blocks[i];
+    if(block->kind == BLOCK_CALL && block->taken < index->size){
+      index->calls[count].caller = block->routine;
+      index->calls[count].callee = block->taken;
+      index->calls[count].sites = 1;
+      count++;
+    }
+  }
+  qsort(index->calls, count, sizeof(CallEdge), compare_edges);
+  index->call_count = 0;
+  for(int i = 0; i < count; i++){
+    CallEdge *last = index->call_count ? &index->calls[index->call_count - 1] : NULL;
+    if(last && compare_edges(last, &index->calls[i]) == 0){
+      last->sites++;
+    }
+    else {
+      index->calls[index->call_count++] = index->calls[i];
+    }
+  }
+}
+
+/*
+ * Recursive descent from the reset vector, then from each RST vector whose
+ * slot was not already decoded as part of another path (on Invaders the
+ * RST 3-7 slots are the middle of the RST 2 handler). Bytes never reached
+ * stay data
+ */
+RomIndex *romindex_analyze(const uint8_t *memory, uint32_t size){
+  if(size == 0 || size > MEMORY_SIZE){
+    return NULL;
+  }
+  RomIndex *index = index_create(size);
+  index->checksum = romindex_checksum(memory, size);
+  Walk *walk = (Walk *) calloc(1, sizeof(Walk));
+
+  for(uint16_t vector = 0; vector <= 0x38 && vector < size; vector += 8){
+    if(index->flags[vector] & (ROMINDEX_CODE | ROMINDEX_OPERAND)){
+      continue;
+    }
+    add_entry(index, vector);
+    index->flags[vector] |= ROMINDEX_ROUTINE | ROMINDEX_LEADER;
+    walk_push(walk, vector);
+    walk_decode(index, walk, memory);
+  }
+  free(walk);
+
+  build_blocks(index, memory);
+  assign_routines(index);
+  build_calls(index);
+  return index;
+}
+
+void romindex_free(RomIndex *index){
+  if(index == NULL){
+    return;
+  }
+  free(index->blocks);
+  free(index->calls);
+  free(index->entries);
+  free(index);
+}
+
+/*
+ * Text index, one record per line, addresses in hex:
+ *
+ *   rom size checksum
+ *   entry adr
+ *   block start end routine kind instructions taken next
+ *   call caller callee sites
+ *   data start end
+ */
+int romindex_write(RomIndex *index, const char *path){
+  FILE *f = fopen(path, "w");
+  if(f == NULL){
+    return -1;
+  }
+  fprintf(f, "# 8080 rom index: rom, entry, block, call and data records\n");
+  fprintf(f, "rom %04x %08x\n", index->size, index->checksum);
+  for(int i = 0; i < index->entry_count; i++){
+    fprintf(f, "entry %04x\n", index->entries[i]);
+  }
+  for(int i = 0; i < index->block_count; i++){
+    RomBlock *block = &index->blocks[i];
+    fprintf(f, "block %04x %04x %04x %s %d %04x %04x\n", block->start, block->end, block->routine,
+            block_kind_names[block->kind], block->instructions, block->taken, block->next);
+  }
+  for(int i = 0; i < index->call_count; i++){
+    fprintf(f, "call %04x %04x %u\n", index->calls[i].caller, index->calls[i].callee, index->calls[i].sites);
+  }
+  uint32_t adr = 0;
+  while(adr < index->size){
+    if(index->flags[adr] & (ROMINDEX_CODE | ROMINDEX_OPERAND)){
+      adr++;
+      continue;
+    }
+    uint32_t start = adr;
+    while(adr < index->size && !(index->flags[adr] & (ROMINDEX_CODE | ROMINDEX_OPERAND))){
+      adr++;
+    }
+    fprintf(f, "data %04x %04x\n", start, adr);
+  }
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+RomIndex *romindex_load(const char *path, const uint8_t *memory){
+  FILE *f = fopen(path, "r");
+  if(f == NULL){
+    return NULL;
+  }
+  RomIndex *index = NULL;
+  int capacity = 0;
+  int ok = 1;
+  char line[256];
+  while(ok && fgets(line, sizeof(line), f)){
+    unsigned a, b, c, d, e;
+    int n;
+    char kind[16];
+    if(line[0] == '#' || line[0] == '\n'){
+      continue;
+    }
+    if(sscanf(line, "rom %x %x", &a, &b) == 2){
+      ok = index == NULL && a > 0 && a <= MEMORY_SIZE && romindex_checksum(memory, a) == b;
+      if(ok){
+        index = index_create(a);
+        index->checksum = b;
+      }
+    }
+    else if(index == NULL){
+      ok = 0;
+    }
+    else if(sscanf(line, "entry %x", &a) == 1){
+      ok = a < index->size;
+      if(ok){
+        add_entry(index, a);
+        index->flags[a] |= ROMINDEX_ROUTINE;
+      }
+    }
+    else if(sscanf(line, "block %x %x %x %15s %d %x %x", &a, &b, &c, kind, &n, &d, &e) == 7){
+      int k = 0;
+      while(k < BLOCK_KINDS && strcmp(kind, block_kind_names[k]) != 0){
+        k++;
+      }
+      ok = k < BLOCK_KINDS && a < b && b <= index->size && index->block_at[a] < 0;
+      if(ok){
+        RomBlock *block = add_block(index, &capacity);
+        block->start = a;
+        block->end = b;
+        block->routine = c;
+        block->kind = k;
+        block->instructions = n;
+        block->taken = d;
+        block->next = e;
+        index->block_at[a] = index->block_count++;
+      }
+    }
+    else if(sscanf(line, "call %x %x %u", &a, &b, &c) == 3){
+      index->calls = (CallEdge *) realloc(index->calls, (index->call_count + 1) * sizeof(CallEdge));
+      index->calls[index->call_count].caller = a;
+      index->calls[index->call_count].callee = b;
+      index->calls[index->call_count].sites = c;
+      index->call_count++;
+    }
+    else if(strncmp(line, "data ", 5) != 0){
+      ok = 0;
+    }
+  }
+  fclose(f);
+  if(!ok || index == NULL){
+    romindex_free(index);
+    return NULL;
+  }
+
+  // the per byte flags follow from walking each block over the image
+  for(int i = 0; i < index->block_count; i++){
+    RomBlock *block = &index->blocks[i];
+    index->flags[block->start] |= ROMINDEX_LEADER;
+    uint32_t pc = block->start;
+    while(pc < block->end){
+      uint8_t op = memory[pc];
+      index->flags[pc] |= ROMINDEX_CODE;
+      for(int j = 1; j < opcode_lengths[op]; j++){
+        index->flags[pc + j] |= ROMINDEX_OPERAND;
+      }
+      if(op == 0xe9){
+        index->flags[pc] |= ROMINDEX_INDIRECT;
+      }
+      pc += opcode_lengths[op];
+    }
+    if(block->kind == BLOCK_JUMP || block->kind == BLOCK_BRANCH || block->kind == BLOCK_CALL){
+      if(block->taken < index->size){
+        index->flags[block->taken] |= block->kind == BLOCK_CALL ? ROMINDEX_ROUTINE : ROMINDEX_TARGET;
+      }
+    }
+  }
+  return index;
+}
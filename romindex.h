@@ -0,0 +1,108 @@
+#ifndef __ROMINDEX__
+#define __ROMINDEX__
+
+#include <stdio.h>
+#include <stdint.h>
+
+// what the analysis found at an address, RomIndex.flags
+#define ROMINDEX_CODE 0x01
+#define ROMINDEX_OPERAND 0x02
+#define ROMINDEX_LEADER 0x04
+#define ROMINDEX_ROUTINE 0x08
+#define ROMINDEX_TARGET 0x10
+#define ROMINDEX_INDIRECT 0x20
+
+// how a basic block ends
+enum {
+  BLOCK_FALL,      // runs into the next leader
+  BLOCK_JUMP,      // JMP, continues at taken
+  BLOCK_BRANCH,    // conditional jump, taken or next
+  BLOCK_CALL,      // CALL, conditional call or RST, to taken and back to next
+  BLOCK_RET,       // RET
+  BLOCK_RET_COND,  // conditional return, or on to next
+  BLOCK_INDIRECT,  // PCHL, target unknown until run time
+  BLOCK_KINDS
+};
+
+extern const char *block_kind_names[BLOCK_KINDS];
+
+/*
+ * the BLOCK_ kind an opcode ends a block with, BLOCK_FALL when it is not
+ * a control transfer
+ */
+int opcode_flow(uint8_t op);
+
+/*
+ * whether an opcode that is not a control transfer stores to memory
+ */
+int opcode_stores(uint8_t op);
+
+/*
+ * a straight run of instructions entered only at start, the last one is
+ * the only control transfer
+ */
+typedef struct RomBlock {
+  uint16_t start;
+  // first address after the block
+  uint16_t end;
+  uint16_t routine;
+  uint8_t kind;
+  uint16_t instructions;
+  // jump, branch or call target
+  uint16_t taken;
+  // where execution continues when the block falls through
+  uint16_t next;
+} RomBlock;
+
+typedef struct CallEdge {
+  uint16_t caller;
+  uint16_t callee;
+  uint32_t sites;
+} CallEdge;
+
+/*
+ * Result of recursive descent disassembly of a ROM: which bytes are code,
+ * its basic blocks, the routines they belong to and the call graph
+ */
+typedef struct RomIndex {
+  uint32_t size;
+  // FNV-1a of the ROM bytes, ties an index file to its image
+  uint32_t checksum;
+  uint8_t flags[1 << 16];
+  // index into blocks of the block starting at an address, -1 for none
+  int32_t block_at[1 << 16];
+  RomBlock *blocks;
+  int block_count;
+  CallEdge *calls;
+  int call_count;
+  uint16_t *entries;
+  int entry_count;
+  // decoding ran into the middle of an earlier instruction
+  int conflicts;
+  // control transfers to addresses outside the ROM
+  int externals;
+} RomIndex;
+
+RomIndex *romindex_analyze(const uint8_t *memory, uint32_t size);
+
+void romindex_free(RomIndex *index);
+
+uint32_t romindex_checksum(const uint8_t *memory, uint32_t size);
+
+int romindex_write(RomIndex *index, const char *path);
+
+/*
+ * read an index written by romindex_write(), memory must hold the ROM it
+ * was built from, NULL if it does not or the file cannot be read
+ */
+RomIndex *romindex_load(const char *path, const uint8_t *memory);
+
+/*
+ * the block starting at adr, NULL if no block starts there
+ */
+static inline RomBlock *romindex_block(RomIndex *index, uint16_t adr){
+  int32_t i = index->block_at[adr];
+  return i < 0 ? NULL : &index->blocks[i];
+}
+
+#endif
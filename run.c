@@ -1,59 +1,17 @@
 #include <stdlib.h> 
 #include <stdio.h> 
 #include <string.h>
+#include <unistd.h>
 #include "emulator.h"
-
-void load_invaders_chunk(char *folder, char chunk, uint8_t *memory) {
-  // create the necessary file path
-  size_t len = strlen(folder); 
-  char *folder_path = (char *) calloc(len + 16, sizeof(*folder_path)); 
-
-  sprintf(folder_path, "%s/invaders.%c", folder, chunk);
-  // open file 
-  FILE *f = fopen(folder_path, "rb");
-  if(f == NULL){
-    exit(1); 
-  }
-
-  fseek(f, 0, SEEK_END);
-  int size = ftell(f); 
-  fseek(f, 0, SEEK_SET); 
-
-  int offset = 0; 
-
-  switch (chunk) {
-    case 'h':
-        offset = 0x0000; 
-        break;
-
-    case 'g':
-	offset = 0x0800; 
-	break;
-
-    case 'f':
-	offset = 0x1000; 
-        break;
-
-    case 'e':
-	offset = 0x1800; 
-        break;
-      
-  }
-  fread(memory + offset, size, 1, f);  
-
-  free(folder_path);
-  fclose(f);
-
-} 
-
-void load_invaders(uint8_t *memory, char *folder) {
-  // load each chunk of invaders into memory
-  load_invaders_chunk(folder, 'h', memory); 
-  load_invaders_chunk(folder, 'g', memory); 
-  load_invaders_chunk(folder, 'f', memory); 
-  load_invaders_chunk(folder, 'e', memory);
-
-}
+#include "rom.h"
+#include "machine.h"
+#include "hash.h"
+#include "profile.h"
+#include "callstack.h"
+#include "sched.h"
+#include "pace.h"
+#include "capture.h"
+#include "sound.h"
 
 void print_state(State8080 *state){
   printf("a: %d\n", state->a);
@@ -71,39 +29,283 @@ void print_state(State8080 *state){
 
 }
 
-int main(){
-  // initialize state
-  State8080 *state; 
-  state = (State8080 *) malloc(sizeof(State8080 *)); 
-  state->a = 0; 
-  state->b = 0; 
-  state->c = 0; 
-  state->d = 0; 
-  state->e = 0;
-  state->h = 0; 
-  state->l = 0; 
-  state->sp = 0; 
-  state->pc = 0; 
-  state->memory = (uint8_t *) malloc((1 << 15) * sizeof(uint8_t *)); 
-  state->int_enable = 0; 
-  // initialize flags
-  state->cc.z = 0; 
-  state->cc.s = 0; 
-  state->cc.p = 0; 
-  state->cc.cy = 0; 
-  state->cc.ac = 0; 
-  // load space invaders into memory 
-  load_invaders(state->memory, "rom");
-  
-  // run the file
-  for(int i = 0; i < 10; i++){
-    printf("opcode: %x\n", state->memory[state->pc]); 
-    emulate(state); 
+void usage(char *name){
+  fprintf(stderr, "usage: %s [-f frames] [-s speed | -t] [-o capture] [-e every] [-d] [-k] [-a sound.wav] [-r rate] | [-n instructions] [-p profile.json] [-c stacks.folded]", name); 
+#ifdef MEMTRACE
+  fprintf(stderr, " [-m heatmap_prefix] [-l line_size]"); 
+#endif
+  fprintf(stderr, "\n"); 
+  exit(1); 
+}
+
+/*
+ * what the recording core feeds, a BatchCore has no ctx. next_pc and
+ * next_sp are where the last instruction left the CPU
+ */
+static struct {
+  Profile *profile;
+  CallStack *stack;
+  int trace;
+  long steps;
+  uint16_t next_pc;
+  uint16_t next_sp;
+} record;
+
+static int record_step(State8080 *state){
+  uint16_t pc = state->pc; 
+  uint16_t sp = state->sp; 
+  uint8_t opcode = state->memory[pc]; 
+  if(record.trace){
+    printf("opcode: %x\n", opcode); 
+  }
+  int cycles = emulate(state); 
+  if(record.profile){
+    profile_record(record.profile, pc, opcode, cycles); 
+  }
+  if(record.stack){
+    callstack_step(record.stack, state, opcode, pc, sp, cycles); 
+  }
+  if(record.trace){
     print_state(state);
   }
+  record.steps++; 
+  record.next_pc = state->pc; 
+  record.next_sp = state->sp; 
+  return cycles; 
+}
+
+/*
+ * a core for the scheduler that runs one instruction through the
+ * recorders, and after an EI the next one as well so interrupt_service()
+ * never steps one they miss. An interrupt taken since the last call left
+ * pc elsewhere with the return address pushed, which the call stack
+ * enters as a call of its handler
+ */
+static int record_core(State8080 *state, int budget){
+  if(record.stack && state->pc != record.next_pc && state->sp == (uint16_t) (record.next_sp - 2)){
+    callstack_enter(record.stack, state->pc, record.next_pc); 
+  }
+  int cycles = record_step(state); 
+  while(state->int_delay){
+    cycles += record_step(state); 
+  }
+  return cycles; 
+}
+
+static void port_write(Machine *machine, uint8_t port, uint8_t previous, uint8_t value, void *ctx){
+  sound_out((Sound *) ctx, machine->sched.now, port, previous, value);
+}
+
+/*
+ * run frames at batch speed, the scheduler stops the core only for the
+ * interrupts and OUT writes and the pacer holds each frame to the wall
+ * clock at speed times real time, 0 for as fast as it goes. Every frame
+ * goes to the capture pipeline if there is one and the writes to the
+ * sound board, the counters to out
+ */
+static void run_frames(Machine *machine, long frames, double speed, Pipeline *capture, Sound *sound, FILE *out){
+  if(sound){
+    machine_listen(machine, port_write, sound);
+  }
+  Pacer pacer;
+  pace_init(&pacer, (double) INVADERS_CLOCK_HZ / INVADERS_FRAME_CYCLES, speed);
+  for(long frame = 1; frame <= frames; frame++){
+    machine_run(machine, emulate_batch, (uint64_t) frame * INVADERS_FRAME_CYCLES);
+    if(capture){
+      pipeline_submit(capture, machine->state.memory, frame, machine->cycles);
+    }
+    if(sound){
+      // keep the blocks coming through quiet stretches
+      sound_advance(sound, machine->cycles);
+    }
+    pace_wait(&pacer);
+  }
+  pace_report(&pacer, out, machine->cycles);
+  pace_free(&pacer);
+  fprintf(out, "%llu cycles in %llu slices, pc %04x\n", (unsigned long long) machine->cycles,
+         (unsigned long long) machine->sched.slices, machine->state.pc);
+  fprintf(out, "interrupts: %llu requested, %llu taken, %llu replaced, %llu delayed by EI\n",
+         (unsigned long long) machine->irq.requested, (unsigned long long) machine->irq.taken,
+         (unsigned long long) machine->irq.replaced, (unsigned long long) machine->irq.delayed);
+  // the same frames give the same hashes on any core and build
+  fprintf(out, "video RAM hash %016llx, RAM hash %016llx\n", (unsigned long long) hash_vram(machine->state.memory),
+         (unsigned long long) hash_ram(machine->state.memory));
+}
+
+int main(int argc, char **argv){
+  long count = 0; 
+  long frames = 600; 
+  double speed = 1; 
+  char *capture_path = NULL; 
+  char *sound_path = NULL; 
+  int rate = 44100; 
+  int lossless = 0; 
+  int every = 1; 
+  int dedup = 0; 
+  char *profile_path = NULL; 
+  char *stacks_path = NULL; 
+  char *heatmap_prefix = NULL; 
+  int line_size = 64; 
+  int opt; 
+  while((opt = getopt(argc, argv, "n:f:s:to:e:dka:r:p:c:m:l:")) != -1){
+    switch(opt){
+      case 'n':
+        count = atol(optarg); 
+        break;
+      case 'f':
+        frames = atol(optarg); 
+        break;
+      case 's':
+        speed = atof(optarg); 
+        break;
+      case 't':
+        speed = 0; 
+        break;
+      case 'o':
+        capture_path = optarg; 
+        break;
+      case 'e':
+        every = atoi(optarg); 
+        break;
+      case 'd':
+        dedup = 1; 
+        break;
+      case 'k':
+        lossless = 1; 
+        break;
+      case 'a':
+        sound_path = optarg; 
+        break;
+      case 'r':
+        rate = atoi(optarg); 
+        break;
+      case 'p':
+        profile_path = optarg; 
+        break;
+      case 'c':
+        stacks_path = optarg; 
+        break;
+      case 'm':
+        heatmap_prefix = optarg; 
+        break;
+      case 'l':
+        line_size = atoi(optarg); 
+        break;
+      default:
+        usage(argv[0]); 
+    }
+  }
+  // heatmap lines are a power of two bytes within the address space
+  if(line_size < 1 || line_size > (1 << 16) || (line_size & (line_size - 1))){
+    usage(argv[0]); 
+  }
+
+  // load space invaders into a machine, registers start cleared
+  uint8_t *image = (uint8_t *) calloc(MEMORY_ALLOC, 1); 
+  load_invaders(image, "rom");
+  MachinePool *pool = machine_pool_create(image, INVADERS_ROM_SIZE, 1); 
+  free(image); 
+  Machine *machine = machine_create(pool); 
+  State8080 *state = &machine->state; 
+  
+  // paced frames unless instructions are to be traced or recorded
+  if(count == 0 && profile_path == NULL && stacks_path == NULL && heatmap_prefix == NULL){
+    Pipeline *capture = NULL; 
+    FrameSink sink; 
+    Sound *sound = NULL; 
+    AudioSink audio; 
+    // video or sound on stdout moves the counters to stderr
+    FILE *out = (capture_path && strcmp(capture_path, "-") == 0) || (sound_path && strcmp(sound_path, "-") == 0) ? stderr : stdout; 
+    if(capture_path){
+      if(capture_open(capture_path, every, &sink) != 0){
+        fprintf(stderr, "could not start capturing to %s\n", capture_path); 
+        return 1; 
+      }
+      if(dedup && !sink.gaps){
+        fprintf(stderr, "-d needs a PNG sequence, a video stream would play faster without the repeated frames\n"); 
+        sink.close(sink.ctx); 
+        return 1; 
+      }
+      if((capture = pipeline_create(sink, lossless, every, dedup)) == NULL){
+        fprintf(stderr, "could not start capturing to %s\n", capture_path); 
+        return 1; 
+      }
+    }
+    if(sound_path){
+      if(rate <= 0 || sound_wav(sound_path, rate, &audio) != 0 || (sound = sound_create(audio, rate, INVADERS_CLOCK_HZ, lossless)) == NULL){
+        fprintf(stderr, "could not start sound to %s\n", sound_path); 
+        return 1; 
+      }
+    }
+    run_frames(machine, frames, speed, capture, sound, out); 
+    if(capture){
+      if(pipeline_close(capture) != 0){
+        fprintf(stderr, "could not write %s\n", capture_path); 
+      }
+      pipeline_report(capture, out); 
+      pipeline_free(capture); 
+    }
+    if(sound){
+      if(sound_close(sound, machine->cycles) != 0){
+        fprintf(stderr, "could not write %s\n", sound_path); 
+      }
+      sound_report(sound, out); 
+      sound_free(sound); 
+    }
+    machine_release(machine); 
+    machine_pool_free(pool); 
+    return 0; 
+  }
+
+  // run count instructions one at a time with the interrupts the game
+  // needs, profiling replaces the per instruction trace
+  count = count ? count : 10; 
+  Profile *profile = profile_path ? profile_create() : NULL; 
+  CallStack *stack = stacks_path ? callstack_create() : NULL; 
+  record.profile = profile; 
+  record.stack = stack; 
+  record.trace = profile == NULL && stack == NULL && heatmap_prefix == NULL; 
+  record.next_pc = state->pc; 
+  record.next_sp = state->sp; 
+  while(record.steps < count){
+    machine_run(machine, record_core, machine->sched.now + 1); 
+  }
+
+  if(profile){
+    profile_report(profile, stdout, 32); 
+    if(profile_write_json(profile, profile_path) != 0){
+      fprintf(stderr, "could not write %s\n", profile_path); 
+    }
+    profile_free(profile); 
+  }
+  if(stack){
+    callstack_close(stack); 
+    callstack_report(stack, stdout, 32); 
+    if(callstack_write_folded(stack, stacks_path) != 0){
+      fprintf(stderr, "could not write %s\n", stacks_path); 
+    }
+    callstack_free(stack); 
+  }
+#ifdef MEMTRACE
+  if(heatmap_prefix){
+    char path[4096]; 
+    snprintf(path, sizeof(path), "%s.csv", heatmap_prefix); 
+    if(memtrace_write_csv(path, line_size) != 0){
+      fprintf(stderr, "could not write %s\n", path); 
+    }
+    snprintf(path, sizeof(path), "%s.ppm", heatmap_prefix); 
+    if(memtrace_write_ppm(path) != 0){
+      fprintf(stderr, "could not write %s\n", path); 
+    }
+  }
+#else
+  if(heatmap_prefix){
+    fprintf(stderr, "memory heatmaps need the memtrace build (make memtrace), %d byte lines ignored\n", line_size); 
+  }
+#endif
   
-  free(state->memory);
-  free(state); 
+  machine_release(machine); 
+  machine_pool_free(pool); 
   return 0;
 }
 
@@ -0,0 +1,139 @@
+#include <string.h>
+#include "sched.h"
+
+void sched_init(Scheduler *sched, Interrupts *irq){
+  memset(sched, 0, sizeof(*sched));
+  sched->irq = irq;
+}
+
+void sched_output(Scheduler *sched, OutputHandler output, void *ctx){
+  sched->output = output;
+  sched->output_ctx = ctx;
+}
+
+static int earlier(const Event *a, const Event *b){
+  return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static void sift_up(Scheduler *sched, int i){
+  Event event = sched->heap[i];
+  while(i > 0 && earlier(&event, &sched->heap[(i - 1) / 2])){
+    sched->heap[i] = sched->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  sched->heap[i] = event;
+}
+
+static void sift_down(Scheduler *sched, int i){
+  Event event = sched->heap[i];
+  for(;;){
+    int child = 2 * i + 1;
+    if(child >= sched->count){
+      break;
+    }
+    if(child + 1 < sched->count && earlier(&sched->heap[child + 1], &sched->heap[child])){
+      child++;
+    }
+    if(!earlier(&sched->heap[child], &event)){
+      break;
+    }
+    sched->heap[i] = sched->heap[child];
+    i = child;
+  }
+  sched->heap[i] = event;
+}
+
+/*
+ * take the event at slot i out of the heap
+ */
+static void remove_at(Scheduler *sched, int i){
+  sched->count--;
+  if(i == sched->count){
+    return;
+  }
+  sched->heap[i] = sched->heap[sched->count];
+  if(i > 0 && earlier(&sched->heap[i], &sched->heap[(i - 1) / 2])){
+    sift_up(sched, i);
+  }
+  else {
+    sift_down(sched, i);
+  }
+}
+
+int sched_at(Scheduler *sched, uint64_t when, EventHandler fire, void *ctx){
+  if(sched->count == SCHED_EVENTS){
+    return -1;
+  }
+  Event *event = &sched->heap[sched->count];
+  event->when = when;
+  event->seq = sched->seq++;
+  event->id = sched->next_id++;
+  event->fire = fire;
+  event->ctx = ctx;
+  sched->count++;
+  sift_up(sched, sched->count - 1);
+  return sched->next_id - 1;
+}
+
+int sched_after(Scheduler *sched, uint64_t delay, EventHandler fire, void *ctx){
+  return sched_at(sched, sched->now + delay, fire, ctx);
+}
+
+int sched_cancel(Scheduler *sched, int id){
+  for(int i = 0; i < sched->count; i++){
+    if(sched->heap[i].id == id){
+      remove_at(sched, i);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static void deliver_output(Scheduler *sched, State8080 *state){
+  if(state->out_written){
+    state->out_written = 0;
+    if(sched->output){
+      sched->output(sched, state->out_port, state->out_value, sched->output_ctx);
+    }
+  }
+}
+
+void sched_fire(Scheduler *sched, State8080 *state){
+  deliver_output(sched, state);
+  while(sched->count && sched->heap[0].when <= sched->now){
+    // off the heap before it runs, the handler may reschedule itself
+    Event event = sched->heap[0];
+    remove_at(sched, 0);
+    sched->fired++;
+    event.fire(sched, state, event.when, event.ctx);
+  }
+  if(sched->irq && sched->irq->pending){
+    // the instruction after an EI may OUT, that write goes out before the
+    // interrupt routine runs and perhaps writes the latch again
+    int spent;
+    while((spent = interrupt_delay_step(sched->irq, state))){
+      sched->now += spent;
+      deliver_output(sched, state);
+    }
+    sched->now += interrupt_service(sched->irq, state);
+  }
+}
+
+uint64_t sched_run(Scheduler *sched, State8080 *state, BatchCore core, uint64_t until){
+  uint64_t start = sched->now;
+  sched_fire(sched, state);
+  while(sched->now < until){
+    uint64_t deadline = sched_deadline(sched);
+    if(deadline > until){
+      deadline = until;
+    }
+    uint64_t budget = deadline - sched->now;
+    if(budget > SCHED_SLICE_MAX){
+      budget = SCHED_SLICE_MAX;
+    }
+    sched->now += core(state, (int) budget);
+    sched->slices++;
+    sched_fire(sched, state);
+  }
+  return sched->now - start;
+}
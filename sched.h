@@ -0,0 +1,110 @@
+#ifndef __SCHED__
+#define __SCHED__
+
+#include <stdint.h>
+#include "emulator.h"
+#include "interrupt.h"
+
+// most events pending at once, a board has a handful of timers
+#define SCHED_EVENTS 32
+// longest stretch the core runs when nothing is due, keeps budgets in an int
+#define SCHED_SLICE_MAX (1 << 20)
+
+struct Scheduler;
+
+/*
+ * called once the CPU has run up to when, the cycle the event was due at.
+ * Periodic events schedule their next run from when rather than from
+ * sched->now, so the lateness of one run does not add up
+ */
+typedef void (*EventHandler)(struct Scheduler *sched, State8080 *state, uint64_t when, void *ctx);
+
+/*
+ * called with a byte the CPU wrote to an output port, sched->now is the
+ * cycle right after the OUT
+ */
+typedef void (*OutputHandler)(struct Scheduler *sched, uint8_t port, uint8_t value, void *ctx);
+
+typedef struct Event {
+  uint64_t when;
+  // scheduling order, events due at the same cycle fire first in first out
+  uint64_t seq;
+  int id;
+  EventHandler fire;
+  void *ctx;
+} Event;
+
+/*
+ * a cycle counted timeline for one CPU: future events sit in a min-heap on
+ * their due cycle and the core runs uninterrupted in slices that end at the
+ * next one. A core only stops between instructions, so an event fires at
+ * most one instruction late, on the first boundary at or after its cycle.
+ * At a boundary an OUT the slice ended on goes to the output handler
+ * first, then the events fire, then the interrupt controller, if there is
+ * one, gets to deliver what they requested. An OUT right after an EI
+ * is passed on before the RST
+ */
+typedef struct Scheduler {
+  uint64_t now;
+  Interrupts *irq;
+  OutputHandler output;
+  void *output_ctx;
+  Event heap[SCHED_EVENTS];
+  int count;
+  uint64_t seq;
+  int next_id;
+  uint64_t fired;
+  uint64_t slices;
+} Scheduler;
+
+/*
+ * runs instructions until at least budget cycles have passed or up to and
+ * including an EI or OUT and returns the cycles, as emulate_batch() does
+ */
+typedef int (*BatchCore)(State8080 *state, int budget);
+
+/*
+ * start at cycle 0 with no events, irq may be NULL
+ */
+void sched_init(Scheduler *sched, Interrupts *irq);
+
+/*
+ * send OUT writes to output, without one they are dropped
+ */
+void sched_output(Scheduler *sched, OutputHandler output, void *ctx);
+
+/*
+ * add an event due at cycle when, returns its id or -1 when the heap is full
+ */
+int sched_at(Scheduler *sched, uint64_t when, EventHandler fire, void *ctx);
+
+int sched_after(Scheduler *sched, uint64_t delay, EventHandler fire, void *ctx);
+
+/*
+ * drop a pending event, returns 0 or -1 if it already fired
+ */
+int sched_cancel(Scheduler *sched, int id);
+
+/*
+ * the cycle the next event is due at, UINT64_MAX with none pending
+ */
+static inline uint64_t sched_deadline(const Scheduler *sched){
+  return sched->count ? sched->heap[0].when : UINT64_MAX;
+}
+
+/*
+ * pass on an OUT, fire every event due by now, including ones their
+ * handlers add, then deliver a pending interrupt if the CPU takes it
+ */
+void sched_fire(Scheduler *sched, State8080 *state);
+
+/*
+ * run core slice by slice until cycle until, firing events at their
+ * deadlines, returns the cycles run. A slice ends early after an EI, so
+ * interrupts held while disabled are taken as soon as the CPU allows, and
+ * after an OUT, so devices see writes at the cycle they happened. The
+ * last slice may overshoot until by part of an instruction
+ */
+uint64_t sched_run(Scheduler *sched, State8080 *state, BatchCore core, uint64_t until);
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emulator.h"
+#include "sched.h"
+#include "interrupt.h"
+
+/*
+ * Checks of the scheduler against small hand assembled programs, run
+ * through emulate_batch() the way the machine runs the board. Prints each
+ * check and exits 1 if any failed.
+ */
+
+#define MAX_WRITES 16
+
+typedef struct Write {
+  uint64_t cycle;
+  uint8_t port;
+  uint8_t value;
+} Write;
+
+typedef struct Writes {
+  Write writes[MAX_WRITES];
+  int count;
+} Writes;
+
+static void record(Scheduler *sched, uint8_t port, uint8_t value, void *ctx){
+  Writes *w = (Writes *) ctx;
+  if(w->count < MAX_WRITES){
+    w->writes[w->count++] = (Write) {sched->now, port, value};
+  }
+}
+
+static void load(uint8_t *memory, uint16_t adr, const uint8_t *code, size_t len){
+  memcpy(memory + adr, code, len);
+  memory_sync_guard(memory);
+}
+
+static int failed;
+
+static void check(int ok, const char *what){
+  printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+  if(!ok){
+    failed = 1;
+  }
+}
+
+/*
+ * EI; OUT 3 with a request waiting, then an interrupt routine that does
+ * OUT 5. The first write has to reach the device before the routine
+ * writes the latch again
+ */
+static void out_after_ei(void){
+  static const uint8_t main_code[] = {
+    0x31, 0x00, 0x24,  // LXI SP,2400
+    0x3e, 0x11,        // MVI A,11
+    0xfb,              // EI
+    0xd3, 0x03,        // OUT 3
+    0xc3, 0x48, 0x00,  // JMP 0048
+  };
+  static const uint8_t isr[] = {
+    0x3e, 0x22,        // MVI A,22
+    0xd3, 0x05,        // OUT 5
+    0xc3, 0x0c, 0x00,  // JMP 000C
+  };
+  uint8_t *memory = (uint8_t *) calloc(MEMORY_ALLOC, 1);
+  load(memory, 0x40, main_code, sizeof(main_code));
+  load(memory, 0x08, isr, sizeof(isr));
+
+  State8080 state;
+  memset(&state, 0, sizeof(state));
+  state.memory = memory;
+  state.pc = 0x40;
+
+  Interrupts irq;
+  Scheduler sched;
+  Writes w = {0};
+  interrupt_init(&irq);
+  sched_init(&sched, &irq);
+  sched_output(&sched, record, &w);
+  // held while interrupts are disabled, taken after the OUT
+  interrupt_request(&irq, 1);
+  sched_run(&sched, &state, emulate_batch, 1000);
+
+  check(irq.taken == 1, "EI; OUT: the interrupt is taken once");
+  check(memory[0x23fe] == 0x48 && memory[0x23ff] == 0x00, "EI; OUT: the RST returns behind the OUT");
+  check(w.count == 2, "EI; OUT: both writes reach the device");
+  check(w.count >= 1 && w.writes[0].port == 3 && w.writes[0].value == 0x11, "EI; OUT: the write after EI comes first");
+  check(w.count >= 2 && w.writes[1].port == 5 && w.writes[1].value == 0x22, "EI; OUT: the interrupt routine's write comes second");
+  check(w.count >= 2 && w.writes[0].cycle < w.writes[1].cycle, "EI; OUT: the writes are timed in order");
+  free(memory);
+}
+
+int main(void){
+  out_after_ei();
+  return failed;
+}
@@ -0,0 +1,345 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sound.h"
+
+static const char *sound_names[SOUND_COUNT] = {
+  "ufo", "shot", "player die", "invader die", "extra life",
+  "fleet 1", "fleet 2", "fleet 3", "fleet 4", "ufo hit",
+};
+
+/*
+ * a sound as a square wave gliding from f0 to f1 mixed with white noise,
+ * the pitch swung by warble and the level gated on and off at pulse_hz,
+ * fading by decay per second
+ */
+typedef struct Synth {
+  double seconds;
+  double f0;
+  double f1;
+  double tone;
+  double noise;
+  double decay;
+  double warble_hz;
+  double warble;
+  double pulse_hz;
+} Synth;
+
+static const Synth synths[SOUND_COUNT] = {
+  // one swing of the warble, so the loop joins up
+  [SOUND_UFO] = {0.16, 800, 800, 0.6, 0, 0, 6.25, 0.3, 0},
+  [SOUND_SHOT] = {0.45, 1600, 300, 0.4, 0.6, 6, 0, 0, 0},
+  [SOUND_PLAYER_DIE] = {1.3, 200, 60, 0.3, 0.8, 2.5, 0, 0, 0},
+  [SOUND_INVADER_DIE] = {0.35, 900, 150, 0.7, 0.3, 8, 0, 0, 0},
+  [SOUND_EXTRA_LIFE] = {0.7, 1200, 1200, 0.8, 0, 0, 0, 0, 8},
+  [SOUND_FLEET1] = {0.12, 62, 62, 1, 0, 12, 0, 0, 0},
+  [SOUND_FLEET2] = {0.12, 58, 58, 1, 0, 12, 0, 0, 0},
+  [SOUND_FLEET3] = {0.12, 55, 55, 1, 0, 12, 0, 0, 0},
+  [SOUND_FLEET4] = {0.12, 52, 52, 1, 0, 12, 0, 0, 0},
+  [SOUND_UFO_HIT] = {1.0, 600, 300, 0.8, 0, 1.5, 12, 0.4, 0},
+};
+
+// full scale of one voice, a few at once stay clear of clipping
+#define VOICE_LEVEL 8000
+
+/*
+ * the samples of a sound, a loop gets no fade at its ends
+ */
+static int16_t *synthesize(const Synth *synth, int loop, uint32_t rate, uint32_t *length){
+  uint32_t n = synth->seconds * rate;
+  int16_t *samples = (int16_t *) malloc(n * sizeof(int16_t));
+  // the same noise every run
+  uint32_t noise = 0x2400;
+  double phase = 0;
+  // a few milliseconds of fade at the ends so a sound does not click
+  double fade = 0.004 * rate;
+  for(uint32_t i = 0; i < n; i++){
+    double t = (double) i / rate;
+    double f = synth->f0 + (synth->f1 - synth->f0) * t / synth->seconds;
+    f *= 1 + synth->warble * sin(2 * M_PI * synth->warble_hz * t);
+    phase += f / rate;
+    phase -= floor(phase);
+    noise ^= noise << 13;
+    noise ^= noise >> 17;
+    noise ^= noise << 5;
+    double v = synth->tone * (phase < 0.5 ? 1 : -1) + synth->noise * ((double) noise / UINT32_MAX * 2 - 1);
+    v *= exp(-synth->decay * t);
+    if(synth->pulse_hz > 0 && fmod(t * synth->pulse_hz, 1) >= 0.5){
+      v = 0;
+    }
+    if(!loop){
+      v *= fmin(1, fmin(i / fade, (n - i) / fade));
+    }
+    samples[i] = (int16_t) (v * VOICE_LEVEL);
+  }
+  *length = n;
+  return samples;
+}
+
+static void *writer_main(void *arg){
+  Sound *sound = (Sound *) arg;
+  int tries = 0;
+  for(;;){
+    int done = atomic_load_explicit(&sound->done, memory_order_acquire);
+    AudioBlock *block = (AudioBlock *) ring_pop(&sound->to_write);
+    if(block == NULL){
+      if(done){
+        break;
+      }
+      ring_wait(&tries);
+      continue;
+    }
+    tries = 0;
+    if(sound->sink.write(sound->sink.ctx, block->samples, block->count) != 0){
+      sound->write_errors++;
+    }
+    sound->written += block->count;
+    ring_push(&sound->free_blocks, block);
+  }
+  return NULL;
+}
+
+Sound *sound_create(AudioSink sink, uint32_t rate, uint64_t clock_hz, int lossless){
+  Sound *sound = (Sound *) calloc(1, sizeof(Sound));
+  sound->sink = sink;
+  sound->lossless = lossless;
+  sound->rate = rate;
+  sound->clock_hz = clock_hz;
+  for(int i = 0; i < SOUND_COUNT; i++){
+    sound->samples[i] = synthesize(&synths[i], i == SOUND_UFO, rate, &sound->lengths[i]);
+  }
+  sound->blocks = (AudioBlock *) malloc(SOUND_DEPTH * sizeof(AudioBlock));
+  ring_init(&sound->to_write, SOUND_DEPTH);
+  ring_init(&sound->free_blocks, SOUND_DEPTH);
+  for(int i = 0; i < SOUND_DEPTH; i++){
+    ring_push(&sound->free_blocks, &sound->blocks[i]);
+  }
+  atomic_init(&sound->done, 0);
+  if(pthread_create(&sound->writer, NULL, writer_main, sound) != 0){
+    sound_free(sound);
+    return NULL;
+  }
+  return sound;
+}
+
+/*
+ * clamp the block's sums to 16 bits and pass it on, or drop it when the
+ * writer has every block and the sound is not lossless
+ */
+static void queue_block(Sound *sound){
+  AudioBlock *block = (AudioBlock *) ring_pop(&sound->free_blocks);
+  if(block == NULL && sound->lossless){
+    sound->stalls++;
+    int tries = 0;
+    while((block = (AudioBlock *) ring_pop(&sound->free_blocks)) == NULL){
+      ring_wait(&tries);
+    }
+  }
+  if(block == NULL){
+    sound->dropped++;
+  }
+  else {
+    for(uint32_t i = 0; i < sound->fill; i++){
+      int32_t v = sound->mix[i];
+      v = v > INT16_MAX ? INT16_MAX : v;
+      v = v < INT16_MIN ? INT16_MIN : v;
+      block->samples[i] = v;
+    }
+    block->count = sound->fill;
+    // there are as many blocks as slots, the push cannot fail
+    ring_push(&sound->to_write, block);
+    sound->queued++;
+  }
+  memset(sound->mix, 0, sizeof(sound->mix));
+  sound->fill = 0;
+}
+
+static void add_samples(int32_t *restrict mix, const int16_t *restrict samples, uint32_t n){
+  for(uint32_t i = 0; i < n; i++){
+    mix[i] += samples[i];
+  }
+}
+
+/*
+ * add the next n samples of every voice into the block, n fits in it.
+ * Voices move on with the amplifier off, only nothing is added
+ */
+static void mix_span(Sound *sound, uint32_t n){
+  int amplifier = sound->amplifier;
+  int32_t *mix = sound->mix + sound->fill;
+  for(int i = 0; i < SOUND_COUNT; i++){
+    Voice *voice = &sound->voices[i];
+    uint32_t done = 0;
+    while(voice->active && done < n){
+      uint32_t span = sound->lengths[i] - voice->pos;
+      if(span > n - done){
+        span = n - done;
+      }
+      if(amplifier){
+        add_samples(mix + done, sound->samples[i] + voice->pos, span);
+      }
+      voice->pos += span;
+      done += span;
+      if(voice->pos == sound->lengths[i]){
+        voice->pos = 0;
+        voice->active = i == SOUND_UFO;
+      }
+    }
+  }
+  sound->fill += n;
+}
+
+void sound_advance(Sound *sound, uint64_t cycle){
+  uint64_t target = (unsigned __int128) cycle * sound->rate / sound->clock_hz;
+  while(sound->rendered < target){
+    uint64_t n = target - sound->rendered;
+    if(n > SOUND_BLOCK - sound->fill){
+      n = SOUND_BLOCK - sound->fill;
+    }
+    mix_span(sound, n);
+    sound->rendered += n;
+    if(sound->fill == SOUND_BLOCK){
+      queue_block(sound);
+    }
+  }
+}
+
+void sound_out(Sound *sound, uint64_t cycle, uint8_t port, uint8_t previous, uint8_t value){
+  if(port != 3 && port != 5){
+    return;
+  }
+  sound_advance(sound, cycle);
+  int bank = port == 5;
+  uint8_t rising = value & ~previous;
+  uint8_t falling = previous & ~value;
+  if(port == 3){
+    sound->amplifier = (value & 0x20) != 0;
+  }
+  for(int bit = 0; bit < 5; bit++){
+    int i = 5 * bank + bit;
+    if(rising >> bit & 1){
+      sound->voices[i].active = 1;
+      sound->voices[i].pos = 0;
+      sound->triggers[i]++;
+    }
+    else if(falling >> bit & 1 && i == SOUND_UFO){
+      sound->voices[i].active = 0;
+    }
+  }
+}
+
+int sound_close(Sound *sound, uint64_t cycle){
+  sound_advance(sound, cycle);
+  if(sound->fill){
+    queue_block(sound);
+  }
+  atomic_store_explicit(&sound->done, 1, memory_order_release);
+  pthread_join(sound->writer, NULL);
+  int status = sound->write_errors ? -1 : 0;
+  if(sound->sink.close && sound->sink.close(sound->sink.ctx) != 0){
+    status = -1;
+  }
+  return status;
+}
+
+void sound_report(Sound *sound, FILE *f){
+  fprintf(f, "sound: %llu samples at %u Hz (%.2f s), %llu blocks, %llu dropped, %llu stalls, %llu written, %llu write errors\n",
+          (unsigned long long) sound->rendered, sound->rate, (double) sound->rendered / sound->rate,
+          (unsigned long long) sound->queued, (unsigned long long) sound->dropped, (unsigned long long) sound->stalls,
+          (unsigned long long) sound->written, (unsigned long long) sound->write_errors);
+  fprintf(f, "started:");
+  for(int i = 0; i < SOUND_COUNT; i++){
+    fprintf(f, "%s %s %llu", i ? "," : "", sound_names[i], (unsigned long long) sound->triggers[i]);
+  }
+  fprintf(f, "\n");
+}
+
+void sound_free(Sound *sound){
+  for(int i = 0; i < SOUND_COUNT; i++){
+    free(sound->samples[i]);
+  }
+  ring_free(&sound->to_write);
+  ring_free(&sound->free_blocks);
+  free(sound->blocks);
+  free(sound);
+}
+
+typedef struct WavSink {
+  FILE *f;
+  uint8_t header[44];
+  uint64_t bytes;
+} WavSink;
+
+static void put16le(uint8_t *out, uint16_t v){
+  out[0] = v;
+  out[1] = v >> 8;
+}
+
+static void put32le(uint8_t *out, uint32_t v){
+  put16le(out, v);
+  put16le(out + 2, v >> 16);
+}
+
+// the RIFF and data sizes for data_bytes of samples
+static void wav_sizes(uint8_t *header, uint32_t data_bytes){
+  put32le(header + 4, data_bytes + 36);
+  put32le(header + 40, data_bytes);
+}
+
+static int wav_write(void *ctx, const int16_t *samples, uint32_t count){
+  WavSink *wav = (WavSink *) ctx;
+  uint8_t bytes[2 * SOUND_BLOCK];
+  for(uint32_t i = 0; i < count; i++){
+    put16le(bytes + 2 * i, samples[i]);
+  }
+  wav->bytes += 2 * count;
+  return fwrite(bytes, 2, count, wav->f) == count ? 0 : -1;
+}
+
+static int wav_close(void *ctx){
+  WavSink *wav = (WavSink *) ctx;
+  int status = 0;
+  if(wav->f != stdout && fseek(wav->f, 0, SEEK_SET) == 0){
+    wav_sizes(wav->header, wav->bytes < UINT32_MAX - 36 ? wav->bytes : UINT32_MAX - 36);
+    if(fwrite(wav->header, 1, 44, wav->f) != 44){
+      status = -1;
+    }
+  }
+  if(wav->f == stdout ? fflush(wav->f) != 0 : fclose(wav->f) != 0){
+    status = -1;
+  }
+  free(wav);
+  return status;
+}
+
+int sound_wav(const char *path, uint32_t rate, AudioSink *sink){
+  FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+  if(f == NULL){
+    return -1;
+  }
+  WavSink *wav = (WavSink *) calloc(1, sizeof(WavSink));
+  wav->f = f;
+  uint8_t *header = wav->header;
+  memcpy(header, "RIFF\0\0\0\0WAVEfmt ", 16);
+  put32le(header + 16, 16);
+  // PCM, mono, 16 bits
+  put16le(header + 20, 1);
+  put16le(header + 22, 1);
+  put32le(header + 24, rate);
+  put32le(header + 28, 2 * rate);
+  put16le(header + 32, 2);
+  put16le(header + 34, 16);
+  memcpy(header + 36, "data", 4);
+  wav_sizes(header, UINT32_MAX - 36);
+  if(fwrite(header, 1, 44, f) != 44){
+    if(f != stdout){
+      fclose(f);
+    }
+    free(wav);
+    return -1;
+  }
+  sink->ctx = wav;
+  sink->write = wav_write;
+  sink->close = wav_close;
+  return 0;
+}
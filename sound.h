@@ -0,0 +1,139 @@
+#ifndef __SOUND__
+#define __SOUND__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ring.h"
+
+// samples per block, what the mixer fills and the writer thread takes
+#define SOUND_BLOCK 512
+// blocks between the two, the most the writer can fall behind
+#define SOUND_DEPTH 32
+
+/*
+ * the sounds of the board, the bits of port 3 and then those of port 5
+ * that start them. Port 3 bit 5 turns the amplifier on, the game leaves
+ * it off in attract mode
+ */
+enum {
+  SOUND_UFO,
+  SOUND_SHOT,
+  SOUND_PLAYER_DIE,
+  SOUND_INVADER_DIE,
+  SOUND_EXTRA_LIFE,
+  SOUND_FLEET1,
+  SOUND_FLEET2,
+  SOUND_FLEET3,
+  SOUND_FLEET4,
+  SOUND_UFO_HIT,
+  SOUND_COUNT
+};
+
+// 16 bit mono
+typedef struct AudioBlock {
+  uint32_t count;
+  int16_t samples[SOUND_BLOCK];
+} AudioBlock;
+
+/*
+ * where the writer thread sends samples, in order. write and close return
+ * 0 or -1 on an error, close may be NULL
+ */
+typedef struct AudioSink {
+  void *ctx;
+  int (*write)(void *ctx, const int16_t *samples, uint32_t count);
+  int (*close)(void *ctx);
+} AudioSink;
+
+// a sound playing, one per sound so a new trigger restarts it
+typedef struct Voice {
+  uint32_t pos;
+  uint8_t active;
+} Voice;
+
+/*
+ * The sound board as a device on the OUT ports. The latches themselves
+ * are the machine's (see machine.h), each write is compared with what
+ * they held before and a bit going up starts its sound from the
+ * beginning; the UFO loops until its bit goes down, the others play to
+ * the end. Samples are made up at startup, the board's were analog
+ * circuits. Time is the CPU's cycle count, not the wall clock: before a
+ * write takes effect the mixer renders up to its cycle, so the audio
+ * lines up with the emulation at any speed and a turbo run makes as many
+ * seconds of it as were emulated. The mixer adds the voices into a block
+ * of 32 bit sums and clamps them to 16 bits a block at a time. Full blocks
+ * go to a writer thread through an SPSC ring and come back through
+ * another; when none is free the block is dropped rather than making the
+ * emulation wait, or in lossless mode the emulation thread waits for one
+ */
+typedef struct Sound {
+  uint32_t rate;
+  uint64_t clock_hz;
+  int16_t *samples[SOUND_COUNT];
+  uint32_t lengths[SOUND_COUNT];
+  Voice voices[SOUND_COUNT];
+  // port 3 bit 5 as last written
+  uint8_t amplifier;
+  int32_t mix[SOUND_BLOCK];
+  uint32_t fill;
+  // samples rendered since cycle 0
+  uint64_t rendered;
+  AudioBlock *blocks;
+  Ring to_write;
+  Ring free_blocks;
+  AudioSink sink;
+  int lossless;
+  pthread_t writer;
+  _Atomic int done;
+  // emulation thread
+  uint64_t triggers[SOUND_COUNT];
+  uint64_t queued;
+  uint64_t dropped;
+  uint64_t stalls;
+  // writer thread
+  uint64_t written;
+  uint64_t write_errors;
+} Sound;
+
+/*
+ * make the samples for rate samples a second of a CPU running at
+ * clock_hz and start the writer thread, NULL if it could not be started
+ */
+Sound *sound_create(AudioSink sink, uint32_t rate, uint64_t clock_hz, int lossless);
+
+/*
+ * render up to cycle
+ */
+void sound_advance(Sound *sound, uint64_t cycle);
+
+/*
+ * value written at cycle to port, whose latch held previous, other ports
+ * than 3 and 5 are ignored. Cycles have to come in order
+ */
+void sound_out(Sound *sound, uint64_t cycle, uint8_t port, uint8_t previous, uint8_t value);
+
+/*
+ * render up to cycle, send the last partial block, stop the writer and
+ * close the sink. Returns -1 if any write or the close failed
+ */
+int sound_close(Sound *sound, uint64_t cycle);
+
+/*
+ * samples made, dropped and written and how often each sound started,
+ * once it is closed
+ */
+void sound_report(Sound *sound, FILE *f);
+
+void sound_free(Sound *sound);
+
+/*
+ * a sink writing a 16 bit mono WAV file, - for stdout. The sizes in the
+ * header are filled in on close when the file can seek, a stream keeps
+ * the largest ones, which players read as "until the end". Returns 0 or
+ * -1 if the file could not be created
+ */
+int sound_wav(const char *path, uint32_t rate, AudioSink *sink);
+
+#endif
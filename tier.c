@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tier.h"
+#include "aot.h"
+#include "romindex.h"
+
+const char *tier_names[TIERS] = {"interpret", "predecoded", "translated"};
+
+Tiering *tier_create(const uint8_t *memory, uint32_t predecode_threshold, uint32_t translate_threshold){
+  Tiering *tiering = (Tiering *) calloc(1, sizeof(Tiering));
+  tiering->entries = (TierEntry *) calloc(MEMORY_SIZE, sizeof(TierEntry));
+  for(int i = 0; i < MEMORY_SIZE; i++){
+    tiering->entries[i].block = -1;
+  }
+  tiering->predecode_threshold = predecode_threshold;
+  tiering->translate_threshold = translate_threshold;
+  for(int op = 0; op < 256; op++){
+    tiering->ends_block[op] = opcode_flow(op) != BLOCK_FALL;
+  }
+
+  if(romindex_checksum(memory, aot_rom_size) == aot_rom_checksum){
+    tiering->rom = (uint8_t *) malloc(aot_rom_size);
+    memcpy(tiering->rom, memory, aot_rom_size);
+    for(int i = 0; i < aot_block_count; i++){
+      tiering->entries[aot_blocks[i].start].translated_end = aot_blocks[i].end;
+    }
+  }
+  return tiering;
+}
+
+void tier_free(Tiering *tiering){
+  free(tiering->entries);
+  free(tiering->blocks);
+  free(tiering->rom);
+  free(tiering);
+}
+
+/*
+ * have stores into [start, end) reported
+ */
+static void watch(Tiering *tiering, uint16_t start, uint32_t end){
+  for(uint32_t page = start >> 8; page <= (end - 1) >> 8; page++){
+    tiering->watch[page] = AOT_WATCHED;
+  }
+}
+
+/*
+ * decode the block at pc into the entry's slot
+ */
+static void predecode(Tiering *tiering, const uint8_t *memory, TierEntry *entry, uint16_t pc){
+  if(entry->block < 0){
+    if(tiering->block_count == tiering->block_capacity){
+      tiering->block_capacity = tiering->block_capacity ? tiering->block_capacity * 2 : 256;
+      tiering->blocks = (TierBlock *) realloc(tiering->blocks, tiering->block_capacity * sizeof(TierBlock));
+    }
+    entry->block = tiering->block_count++;
+  }
+  TierBlock *block = &tiering->blocks[entry->block];
+  uint32_t adr = pc;
+  block->start = pc;
+  block->count = 0;
+  while(block->count < TIER_BLOCK_MAX){
+    uint8_t op = memory[adr];
+    // keep the block from wrapping around the top of memory
+    if(adr + opcode_lengths[op] >= MEMORY_SIZE){
+      break;
+    }
+    block->ops[block->count].adr = adr;
+    block->ops[block->count].opcode = op;
+    block->count++;
+    adr += opcode_lengths[op];
+    if(tiering->ends_block[op]){
+      break;
+    }
+  }
+  if(block->count == 0){
+    // a lone instruction across 0xffff, leave it to the interpreter
+    entry->tier = TIER_INTERPRET;
+    entry->hits = 0;
+    return;
+  }
+  block->end = adr;
+  memcpy(block->bytes, memory + pc, adr - pc);
+  idiom_match(memory, pc, &block->idiom);
+  watch(tiering, pc, adr);
+  entry->tier = TIER_PREDECODED;
+  tiering->stats.promotions[TIER_PREDECODED]++;
+}
+
+static void promote(Tiering *tiering, const uint8_t *memory, TierEntry *entry, uint16_t pc){
+  if(entry->hits >= tiering->translate_threshold && entry->translated_end && tiering->rom &&
+     memcmp(memory + pc, tiering->rom + pc, entry->translated_end - pc) == 0){
+    entry->tier = TIER_TRANSLATED;
+    tiering->gate[pc] = 1;
+    watch(tiering, pc, entry->translated_end);
+    tiering->stats.promotions[TIER_TRANSLATED]++;
+  }
+  else if(entry->tier == TIER_INTERPRET && entry->hits >= tiering->predecode_threshold){
+    predecode(tiering, memory, entry, pc);
+  }
+}
+
+/*
+ * the block still holds the bytes its tier was built from
+ */
+static int still_valid(Tiering *tiering, const uint8_t *memory, TierEntry *entry, uint16_t pc){
+  if(entry->tier == TIER_TRANSLATED){
+    return memcmp(memory + pc, tiering->rom + pc, entry->translated_end - pc) == 0;
+  }
+  TierBlock *block = &tiering->blocks[entry->block];
+  return memcmp(memory + pc, block->bytes, block->end - pc) == 0;
+}
+
+/*
+ * lowest address the instruction at pc is about to store to, -1 if it does
+ * not store. Stores are at most two bytes
+ */
+static int32_t store_address(State8080 *state, uint8_t op){
+  uint16_t pc = state->pc;
+  switch(op){
+    case 0x02: return state->bc; // STAX B
+    case 0x12: return state->de; // STAX D
+    case 0x22: case 0x32: // SHLD, STA
+      return make_word(MEM_READ(state, pc + 2), MEM_READ(state, pc + 1));
+    case 0x34: case 0x35: case 0x36: // INR M, DCR M, MVI M
+      return state->hl;
+    case 0xe3: return state->sp; // XTHL
+  }
+  if(op >= 0x70 && op <= 0x77 && op != 0x76){
+    return state->hl; // MOV M,r
+  }
+  if((op & 0xcf) == 0xc5 || (op & 0xc7) == 0xc7 || (op & 0xc7) == 0xc4 || opcode_flow(op) == BLOCK_CALL){
+    return (uint16_t) (state->sp - 2); // PUSH, RST, calls
+  }
+  return -1;
+}
+
+/*
+ * emulate() has no store hook, so the interpreter works out where each
+ * store goes and flags watched pages itself
+ */
+static int interpret_block(Tiering *tiering, State8080 *state, int *count, int *touched){
+  int cycles = 0;
+  for(int n = 0; n < TIER_BLOCK_MAX; n++){
+    uint8_t op = MEM_FETCH(state, state->pc);
+    int32_t adr = store_address(state, op);
+    if(adr >= 0){
+      for(int i = 0; i < 2; i++){
+        uint8_t page = (uint16_t) (adr + i) >> 8;
+        if(tiering->watch[page]){
+          tiering->watch[page] = AOT_WRITTEN;
+          *touched = 1;
+        }
+      }
+    }
+    cycles += emulate(state);
+    (*count)++;
+    if(tiering->ends_block[op] || state->int_delay || state->out_written){
+      break;
+    }
+  }
+  return cycles;
+}
+
+static void demote(Tiering *tiering, TierEntry *entry, uint16_t pc){
+  entry->tier = TIER_INTERPRET;
+  entry->hits = 0;
+  tiering->gate[pc] = 0;
+  tiering->stats.demotions++;
+}
+
+/*
+ * check every promoted block that can reach into a page that was written,
+ * blocks are shorter than a page so they start in it or the one before
+ */
+static void check_written(Tiering *tiering, const uint8_t *memory){
+  for(int page = 0; page < 256; page++){
+    if(tiering->watch[page] != AOT_WRITTEN){
+      continue;
+    }
+    tiering->watch[page] = AOT_WATCHED;
+    for(uint32_t pc = page ? (page - 1) << 8 : 0; pc < (uint32_t) (page + 1) << 8; pc++){
+      TierEntry *entry = &tiering->entries[pc];
+      if(entry->tier != TIER_INTERPRET && !still_valid(tiering, memory, entry, pc)){
+        demote(tiering, entry, pc);
+      }
+    }
+  }
+}
+
+void tier_invalidate(Tiering *tiering, const uint8_t *memory, uint16_t start, uint32_t end){
+  for(uint32_t page = start >> 8; page <= (end - 1) >> 8; page++){
+    if(tiering->watch[page]){
+      tiering->watch[page] = AOT_WRITTEN;
+    }
+  }
+  check_written(tiering, memory);
+}
+
+static int run_predecoded(Tiering *tiering, TierBlock *block, State8080 *state, int budget, int *count, int *touched){
+  if(block->idiom.kind != IDIOM_NONE && idiom_enabled){
+    uint16_t written;
+    uint32_t passes = idiom_run(&block->idiom, state, budget, &written);
+    if(passes){
+      *touched = aot_watch_range(tiering->watch, written, passes);
+      *count = passes * block->idiom.instructions;
+      return passes * block->idiom.cycles;
+    }
+  }
+  AotRegs r;
+  AOT_LOAD(r, state);
+  r.gate = tiering->gate;
+  r.watch = tiering->watch;
+  r.touched = 0;
+  int cycles = 0;
+  int i = 0;
+  while(i < block->count){
+    uint8_t op = block->ops[i].opcode;
+    r.pc = block->ops[i].adr + 1;
+    cycles += opcode_cycles[op] + aot_step(&r, op);
+    i++;
+    // the store may have changed the rest of this block, which has to be
+    // checked before it runs
+    if(r.touched){
+      break;
+    }
+  }
+  *count = i;
+  AOT_STORE(r, state);
+  *touched = r.touched;
+  return cycles;
+}
+
+int tier_run(Tiering *tiering, State8080 *state, int budget, uint64_t *instructions){
+  TierStats *stats = &tiering->stats;
+  int cycles = 0;
+  // a write from before is held back so the loop stops at one of its own
+  uint8_t pending = state->out_written;
+  state->out_written = 0;
+  state->int_delay = 0;
+  while(cycles < budget && !state->int_delay && !state->out_written){
+    uint16_t pc = state->pc;
+    TierEntry *entry = &tiering->entries[pc];
+    entry->hits++;
+    if(entry->tier != TIER_INTERPRET && !still_valid(tiering, state->memory, entry, pc)){
+      // the code was written over since it was promoted
+      demote(tiering, entry, pc);
+      entry->hits = 1;
+    }
+    if(entry->tier != TIER_TRANSLATED){
+      promote(tiering, state->memory, entry, pc);
+    }
+
+    int count = 0;
+    int spent;
+    int touched = 0;
+    int tier = entry->tier;
+    if(tier == TIER_TRANSLATED){
+      uint64_t translated = 0;
+      spent = aot_run_gated(state, budget - cycles, &translated, tiering->gate, tiering->watch, &touched);
+      count = translated;
+    }
+    else if(tier == TIER_PREDECODED){
+      TierBlock *block = &tiering->blocks[entry->block];
+      spent = run_predecoded(tiering, block, state, budget - cycles, &count, &touched);
+    }
+    else {
+      spent = interpret_block(tiering, state, &count, &touched);
+    }
+    if(touched){
+      check_written(tiering, state->memory);
+    }
+    stats->blocks[tier]++;
+    stats->instructions[tier] += count;
+    stats->cycles[tier] += spent;
+    cycles += spent;
+    *instructions += count;
+  }
+  state->out_written |= pending;
+  return cycles;
+}
+
+static int compare_hits(const void *a, const void *b){
+  const TierEntry *x = *(const TierEntry **) a;
+  const TierEntry *y = *(const TierEntry **) b;
+  return (x->hits < y->hits) - (x->hits > y->hits);
+}
+
+void tier_report(Tiering *tiering, FILE *f, int top){
+  TierStats *stats = &tiering->stats;
+  long entries[TIERS] = {0};
+  TierEntry **hot = (TierEntry **) malloc(MEMORY_SIZE * sizeof(TierEntry *));
+  int count = 0;
+  for(int i = 0; i < MEMORY_SIZE; i++){
+    if(tiering->entries[i].hits){
+      entries[tiering->entries[i].tier]++;
+      hot[count++] = &tiering->entries[i];
+    }
+  }
+  fprintf(f, "thresholds: predecode %u, translate %u%s\n", tiering->predecode_threshold, tiering->translate_threshold,
+          tiering->rom ? "" : " (no translation for this ROM)");
+  fprintf(f, "%-11s %8s %12s %14s %12s %10s\n", "tier", "entries", "blocks", "instructions", "cycles", "promotions");
+  for(int t = 0; t < TIERS; t++){
+    fprintf(f, "%-11s %8ld %12llu %14llu %12llu %10llu\n", tier_names[t], entries[t],
+            (unsigned long long) stats->blocks[t], (unsigned long long) stats->instructions[t],
+            (unsigned long long) stats->cycles[t], (unsigned long long) stats->promotions[t]);
+  }
+  fprintf(f, "demotions:  %llu\n", (unsigned long long) stats->demotions);
+
+  qsort(hot, count, sizeof(TierEntry *), compare_hits);
+  if(top > 0 && count > 0){
+    fprintf(f, "\n%-6s %12s %-11s\n", "pc", "hits", "tier");
+  }
+  for(int i = 0; i < count && i < top; i++){
+    fprintf(f, "%04x   %12u %-11s\n", (unsigned) (hot[i] - tiering->entries), hot[i]->hits, tier_names[hot[i]->tier]);
+  }
+  free(hot);
+}
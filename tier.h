@@ -0,0 +1,114 @@
+#ifndef __TIER__
+#define __TIER__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "emulator.h"
+#include "idiom.h"
+
+// how a block entry point is executed, promoted in this order
+enum {
+  TIER_INTERPRET,
+  TIER_PREDECODED,
+  TIER_TRANSLATED,
+  TIERS
+};
+
+extern const char *tier_names[TIERS];
+
+// instructions in one block, longer straight runs are cut in pieces
+#define TIER_BLOCK_MAX 32
+
+typedef struct TierOp {
+  uint16_t adr;
+  uint8_t opcode;
+} TierOp;
+
+/*
+ * a block decoded once from memory, ending at its first control transfer.
+ * bytes is what it was decoded from, checked on every entry
+ */
+typedef struct TierBlock {
+  uint16_t start;
+  uint16_t end;
+  int count;
+  TierOp ops[TIER_BLOCK_MAX];
+  uint8_t bytes[TIER_BLOCK_MAX * 3];
+  // the block is a whole loop idiom_run() can do in one go
+  Idiom idiom;
+} TierBlock;
+
+typedef struct TierEntry {
+  uint32_t hits;
+  uint8_t tier;
+  // predecoded block, -1 before the first promotion
+  int32_t block;
+  // end of the translated block starting here, 0 if there is none
+  uint16_t translated_end;
+} TierEntry;
+
+/*
+ * counters for tuning the thresholds. blocks counts the runs the manager
+ * started in each tier (a translated run goes on through every translated
+ * block it can reach), instructions and cycles are what those runs did
+ */
+typedef struct TierStats {
+  uint64_t blocks[TIERS];
+  uint64_t instructions[TIERS];
+  uint64_t cycles[TIERS];
+  uint64_t promotions[TIERS];
+  uint64_t demotions;
+} TierStats;
+
+/*
+ * Tiered execution: every block entry pc starts out interpreted with
+ * emulate() and counts its executions. At predecode_threshold its block
+ * is decoded into a TierBlock and run from there, at translate_threshold
+ * it switches to the ahead of time translation (aot.h) if the ROM index
+ * had a block starting at that pc. Translated blocks chain into each
+ * other through gate. A block whose bytes changed since it was promoted
+ * goes back to the interpreter and counts from zero: the bytes are checked
+ * whenever the manager enters a block, and a store from the faster tiers
+ * into a watched page ends their run right after it so the blocks there
+ * are checked too
+ */
+typedef struct Tiering {
+  TierEntry *entries;
+  TierBlock *blocks;
+  int block_count;
+  int block_capacity;
+  uint32_t predecode_threshold;
+  uint32_t translate_threshold;
+  // the ROM the translation was generated from, NULL when it does not
+  // match memory and the translated tier is off
+  uint8_t *rom;
+  // translated entry points, aot_run_gated() may jump to these
+  uint8_t gate[MEMORY_SIZE];
+  // pages with promoted code, see AotRegs
+  uint8_t watch[256];
+  // opcodes that end a block
+  uint8_t ends_block[256];
+  TierStats stats;
+} Tiering;
+
+Tiering *tier_create(const uint8_t *memory, uint32_t predecode_threshold, uint32_t translate_threshold);
+
+void tier_free(Tiering *tiering);
+
+/*
+ * run blocks until at least budget cycles have passed or up to and
+ * including an EI or an OUT, adds the instructions executed to *instructions and
+ * returns the cycles. Loops idiom_match() knows run as bulk operations in
+ * both faster tiers
+ */
+int tier_run(Tiering *tiering, State8080 *state, int budget, uint64_t *instructions);
+
+/*
+ * stores made from outside the emulated CPU (loading or patching memory)
+ * have to be reported so promoted blocks in [start, end) are rechecked
+ */
+void tier_invalidate(Tiering *tiering, const uint8_t *memory, uint16_t start, uint32_t end);
+
+void tier_report(Tiering *tiering, FILE *f, int top);
+
+#endif